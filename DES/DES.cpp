@@ -88,6 +88,7 @@ uint32_t DESEncrypter::feistel(uint32_t& ri_minus1, int round)
 
 void DESEncrypter::init_C0_and_D0(uint32_t& C0, uint32_t& D0)
 {
+	DES_PERF_SCOPE(PERF_KEY_SCHEDULE);
 	append_key_to_odd();
 	//???where we are using this append???(used for correctness checking, but not here)
 	transformation(key, BLOCK_SIZE, key_permutation_array);
@@ -99,6 +100,7 @@ void DESEncrypter::init_C0_and_D0(uint32_t& C0, uint32_t& D0)
 
 void DESEncrypter::update_key(uint32_t& C, uint32_t& D, int round)
 {
+	DES_PERF_SCOPE(PERF_KEY_SCHEDULE);
 	if (mode == Mode::ENCRYPT)
 	{
 		C = rol(C, key_round_encrypt_shifting_array[round], 28);
@@ -129,20 +131,22 @@ uint64_t DESEncrypter::run()
 	uint32_t Ci = 0;
 	uint32_t Di = 0;
 	init_C0_and_D0(Ci, Di);
-	const int ROUNDS = 16;
-	for (int i = 0; i < ROUNDS; ++i)	//16 rounds of encrypting
 	{
-		update_key(Ci, Di, i);
-		uint32_t ltemp = Li;
-		if (mode == Mode::ENCRYPT)
+		DES_PERF_SCOPE(PERF_ROUNDS);
+		for (int i = 0; i < ROUNDS; ++i)	//16 rounds of encrypting
 		{
-			Li = Ri;
-			Ri = modulo2_addition(ltemp, feistel(Ri, i));
-		}
-		else    //decrypt
-		{
-			Li = modulo2_addition(Ri, feistel(Li, i));
-			Ri = ltemp;
+			update_key(Ci, Di, i);
+			uint32_t ltemp = Li;
+			if (mode == Mode::ENCRYPT)
+			{
+				Li = Ri;
+				Ri = modulo2_addition(ltemp, feistel(Ri, i));
+			}
+			else    //decrypt
+			{
+				Li = modulo2_addition(Ri, feistel(Li, i));
+				Ri = ltemp;
+			}
 		}
 	}
 	block = ((uint64_t)Li << 32) + Ri;
@@ -150,6 +154,24 @@ uint64_t DESEncrypter::run()
 	return block;
 }
 
+/*
+Key schedule: returns keys of all 16 rounds(in order of using by run()) without processing of block.
+*/
+std::array<uint64_t, ROUNDS> DESEncrypter::round_keys() const
+{
+	DESEncrypter schedule{ *this };
+	std::array<uint64_t, ROUNDS> keys;
+	uint32_t Ci = 0;
+	uint32_t Di = 0;
+	schedule.init_C0_and_D0(Ci, Di);
+	for (int i = 0; i < ROUNDS; ++i)
+	{
+		schedule.update_key(Ci, Di, i);
+		keys[i] = schedule.key;
+	}
+	return keys;
+}
+
 /*
 Addition modulo 2 of two 64 bits numbers(blocks), which in fact may be 48 bits expanded half-blocks
 */
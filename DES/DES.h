@@ -6,7 +6,9 @@
 #include <memory>
 #include <limits.h>
 #include <cstring>
+#include <stdexcept>
 #include <stdint.h>
+#include "DESPerf.h"
 
 /*------------------------------------------------------------------------------------------------------------*/
 
@@ -16,6 +18,7 @@ static const int EXPANDED_HALF_BLOCK_SIZE = 48;
 static const int KEY_SIZE = 56;
 static const int EXPANDED_KEY_SIZE = 64;
 static const int FINAL_KEY_SIZE = 48;
+static const int ROUNDS = 16;
 
 typedef unsigned char uchar;
 typedef unsigned long long ull;
@@ -197,6 +200,7 @@ public:
 		}
 	}
 	uint64_t run();
+	std::array<uint64_t, ROUNDS> round_keys() const;
 private:
 	void append_key_to_odd();
 	void take_7bits();
@@ -269,6 +273,7 @@ template<typename T>
 void transformation(uint64_t& block, int size, T& transform_array)
 {
 	// 64bits = 8bytes, can be represented as ull
+	DES_PERF_SCOPE(PERF_PERMUTATION);
 	uint64_t block_copy = block;
 	uint64_t res = 0;
 	uint64_t temp = 0;
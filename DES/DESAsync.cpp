@@ -0,0 +1,44 @@
+#include "stdafx.h"
+#include "DESAsync.h"
+
+
+// files processed at once, the rest wait in the queue of the pool
+static const int IO_THREADS = 4;
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+ThreadPoolMy& async_io_pool()
+{
+	static ThreadPoolMy pool(IO_THREADS);
+	return pool;
+}
+
+static Crypt_Awaitable<int> run_file_async(File_Crypter crypter, int mode, Resume_Fn resume_on)
+{
+	crypter.mode = mode;
+	return Crypt_Awaitable<int>(async_io_pool(), [crypter]() mutable { return crypter.run(); }, std::move(resume_on));
+}
+
+Crypt_Awaitable<int> encrypt_file_async(File_Crypter crypter, Resume_Fn resume_on)
+{
+	return run_file_async(std::move(crypter), File_Crypter::Encrypt, std::move(resume_on));
+}
+
+Crypt_Awaitable<int> decrypt_file_async(File_Crypter crypter, Resume_Fn resume_on)
+{
+	return run_file_async(std::move(crypter), File_Crypter::Decrypt, std::move(resume_on));
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Crypt_Awaitable<long long> encrypt_buffer_async(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config, Resume_Fn resume_on)
+{
+	ThreadPoolMy& pool = config.thread_pool ? *config.thread_pool : ThreadPoolMy::shared();
+	return Crypt_Awaitable<long long>(pool, [in, out, config]() { return encrypt(in, out, config); }, std::move(resume_on));
+}
+
+Crypt_Awaitable<long long> decrypt_buffer_async(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config, Resume_Fn resume_on)
+{
+	ThreadPoolMy& pool = config.thread_pool ? *config.thread_pool : ThreadPoolMy::shared();
+	return Crypt_Awaitable<long long>(pool, [in, out, config]() { return decrypt(in, out, config); }, std::move(resume_on));
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include "DESBuffer.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Resumes suspended coroutine on executor of caller(for example, posts handle into queue of its reactor).
+Empty - coroutine is resumed on the thread that finished the work.
+*/
+typedef std::function<void(std::coroutine_handle<>)> Resume_Fn;
+
+/*
+Awaitable operation: work is started on pool when coroutine is suspended,
+coroutine is resumed with resume_on when work is done, co_await returns result of work
+or rethrows its exception.
+Works with any coroutine type, awaitable must be awaited once.
+*/
+template<typename T>
+class Crypt_Awaitable
+{
+public:
+	Crypt_Awaitable(ThreadPoolMy& pool_, std::function<T()> work_, Resume_Fn resume_on_)
+		: pool(pool_), work(std::move(work_)), resume_on(std::move(resume_on_))
+	{
+	}
+	inline bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		pool.wait_do_task([this, handle]()
+		{
+			try
+			{
+				result.emplace(work());
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			// awaitable lives in the frame of coroutine, that may be resumed and destroyed by executor of caller
+			// while resume is still running here, so no member is touched after handle is given away
+			Resume_Fn resume = std::move(resume_on);
+			std::coroutine_handle<> suspended = handle;
+			if (resume)
+			{
+				resume(suspended);
+			}
+			else
+			{
+				suspended.resume();
+			}
+		});
+	}
+	T await_resume()
+	{
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+		return std::move(*result);
+	}
+private:
+	ThreadPoolMy& pool;
+	std::function<T()> work;
+	Resume_Fn resume_on;
+	std::optional<T> result;
+	std::exception_ptr error;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Pool of I/O threads for file operations: File_Crypter::run blocks on reading and writing there,
+not on threads of caller or compute pool. Created on first call.
+*/
+ThreadPoolMy& async_io_pool();
+
+/*
+File_Crypter::run of crypter(its ifname, ofname, keys and settings) in Encrypt or Decrypt mode on async_io_pool,
+chunks are processed by pool of crypter in multithread mode.
+co_await returns result of run: 0 - done, -1 - files could not be opened, read or written.
+*/
+Crypt_Awaitable<int> encrypt_file_async(File_Crypter crypter, Resume_Fn resume_on = nullptr);
+Crypt_Awaitable<int> decrypt_file_async(File_Crypter crypter, Resume_Fn resume_on = nullptr);
+
+/*
+encrypt/decrypt of DESBuffer.h on pool of config(ThreadPoolMy::shared() if not set),
+in and out may be the same memory and must stay alive until coroutine is resumed.
+co_await returns bytes written, -1 if out is too small.
+*/
+Crypt_Awaitable<long long> encrypt_buffer_async(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config, Resume_Fn resume_on = nullptr);
+Crypt_Awaitable<long long> decrypt_buffer_async(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config, Resume_Fn resume_on = nullptr);
@@ -0,0 +1,376 @@
+#include "stdafx.h"
+#include "DESAutotune.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+typedef std::chrono::steady_clock tune_clock;
+
+// every calibration pass takes about this time, so whole autotune is well under a second per stage
+static const double PASS_SECONDS = 0.02;
+static const int CHUNK_SIZES[] = { 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+
+static double seconds_since(tune_clock::time_point start)
+{
+	return std::chrono::duration<double>(tune_clock::now() - start).count();
+}
+
+/*
+Best of three runs of f, in seconds
+*/
+template<typename F>
+static double best_of_3(F f)
+{
+	double best = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		tune_clock::time_point start = tune_clock::now();
+		f();
+		double seconds = seconds_since(start);
+		best = i ? std::min(best, seconds) : seconds;
+	}
+	return best;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static int tune_engine(File_Crypter& fc, std::vector<uint64_t>& data, std::ostream& log)
+{
+	int best_engine = File_Crypter::Reference;
+	double best_ns = 0;
+	for (int engine : { File_Crypter::Reference, File_Crypter::Table })
+	{
+		fc.engine = engine;
+		double ns = best_of_3([&]() { fc.run_des(reinterpret_cast<char*>(data.data()), data.size()); }) * 1e9 / data.size();
+		log << "engine " << engine_name(engine) << ": " << ns << " ns/block\n";
+		if (engine == File_Crypter::Reference || ns < best_ns)
+		{
+			best_engine = engine;
+			best_ns = ns;
+		}
+	}
+	return best_engine;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Splits data between calling thread and pool the same way run_mt does
+*/
+static void run_split(File_Crypter& fc, ThreadPoolMy* pool, std::vector<uint64_t>& data)
+{
+	int portions = pool ? pool->size() + 1 : 1;
+	int blocks = data.size() / portions;
+	task_group group;
+	for (int i = 0; i < portions - 1; ++i)
+	{
+		char* portion = reinterpret_cast<char*>(data.data() + i * blocks);
+		pool->wait_do_task([&fc, portion, blocks]() { fc.run_des(portion, blocks); }, group);
+	}
+	char* last = reinterpret_cast<char*>(data.data() + (portions - 1) * blocks);
+	fc.run_des(last, data.size() - (portions - 1) * blocks);
+	if (pool)
+	{
+		pool->wait_group(group);
+	}
+}
+
+static int tune_threads(File_Crypter& fc, std::vector<uint64_t>& data, std::ostream& log)
+{
+	std::vector<int> candidates;
+	int max_threads = default_concurrency();
+	for (int t = 1; t < max_threads; t *= 2)
+	{
+		candidates.push_back(t);
+	}
+	candidates.push_back(max_threads);
+
+	std::vector<double> times;
+	for (int t : candidates)
+	{
+		std::unique_ptr<ThreadPoolMy> pool;
+		if (t > 1)
+		{
+			pool.reset(new ThreadPoolMy(t - 1));
+		}
+		times.push_back(best_of_3([&]() { run_split(fc, pool.get(), data); }));
+		log << "threads " << t << ": " << times.back() * 1000 << " ms\n";
+	}
+	// more threads cost CPU time of other processes, so they have to be noticeably faster
+	double best = *std::min_element(times.begin(), times.end());
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		if (times[i] <= best * 1.05)
+		{
+			return candidates[i];
+		}
+	}
+	return 1;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Bytes of input file used by calibration passes, 0 if input is empty, unreadable or stdin(it can be read only once)
+*/
+static long long sample_size(const File_Crypter& fc)
+{
+	return fc.ifname == "-" ? 0 : std::min(get_file_size(fc.ifname), 16LL * 1024 * 1024);
+}
+
+/*
+Reads up to sample_bytes of input file with backend io in chunks of size chunk, processing them if process is set
+*/
+static void read_pass(File_Crypter& fc, int io, char* buffer, int chunk, long long sample_bytes, bool process)
+{
+	std::unique_ptr<Byte_Reader> in = open_reader(fc.ifname, io);
+	int got = chunk;
+	for (long long done = 0; in && done < sample_bytes && got == chunk; done += got)
+	{
+		got = in->read(buffer, chunk);
+		if (process)
+		{
+			fc.run_des(buffer, got / BLOCKSIZE);
+		}
+	}
+}
+
+/*
+Reads and processes up to sample_bytes of input file with chunks of every size.
+Sample is read once before, so every size runs with the same state of page cache.
+*/
+static int tune_buffer_size(File_Crypter& fc, std::ostream& log)
+{
+	long long sample_bytes = sample_size(fc);
+	if (sample_bytes <= 0)
+	{
+		log << "buffer size: input is empty, unreadable or stdin, default is kept\n";
+		return BUFSIZE;
+	}
+	Pooled_Buffer buffer(CHUNK_SIZES[sizeof(CHUNK_SIZES) / sizeof(CHUNK_SIZES[0]) - 1]);
+	auto pass = [&](int chunk) { read_pass(fc, fc.io, buffer.get(), chunk, sample_bytes, true); };
+	pass(CHUNK_SIZES[0]);
+
+	int best_chunk = BUFSIZE;
+	double best_seconds = 0;
+	for (int chunk : CHUNK_SIZES)
+	{
+		double seconds = best_of_3([&]() { pass(chunk); });
+		log << "buffer size " << chunk / 1024 << " KB: " << sample_bytes / (1024.0 * 1024.0) / seconds << " MB/s\n";
+		if (chunk == CHUNK_SIZES[0] || seconds < best_seconds)
+		{
+			best_chunk = chunk;
+			best_seconds = seconds;
+		}
+	}
+	return best_chunk;
+}
+
+/*
+Reads input file with every backend(with the chosen chunk size, without processing, so only I/O is compared).
+Stream backend is kept unless descriptors are noticeably faster.
+*/
+static int tune_io(File_Crypter& fc, std::ostream& log)
+{
+	long long sample_bytes = sample_size(fc);
+	if (sample_bytes <= 0)
+	{
+		log << "io: input is empty, unreadable or stdin, default is kept\n";
+		return IO_STREAM;
+	}
+	const int chunk = std::max(BLOCKSIZE, fc.buffer_size - fc.buffer_size % BLOCKSIZE);
+	Pooled_Buffer buffer(chunk);
+	double seconds[2];
+	for (int io : { IO_STREAM, IO_FD })
+	{
+		seconds[io] = best_of_3([&]() { read_pass(fc, io, buffer.get(), chunk, sample_bytes, false); });
+		log << "io " << io_name(io) << ": " << sample_bytes / (1024.0 * 1024.0) / seconds[io] << " MB/s\n";
+	}
+	return seconds[IO_FD] * 1.05 < seconds[IO_STREAM] ? IO_FD : IO_STREAM;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Tuning_Profile autotune(const File_Crypter& crypter, std::ostream& log)
+{
+	File_Crypter fc = crypter;
+	fc.multithread = false;
+	Tuning_Profile profile;
+
+	std::vector<uint64_t> data(4096);
+	for (uint64_t& block : data)
+	{
+		block = generate_random64();
+	}
+	profile.engine = tune_engine(fc, data, log);
+	fc.engine = profile.engine;
+
+	// enough blocks for PASS_SECONDS of work on one thread
+	data.resize(std::max<size_t>(data.size(), (size_t)(PASS_SECONDS * 1e9 / fc.block_cost_ns())));
+	profile.threads = tune_threads(fc, data, log);
+
+	profile.buffer_size = tune_buffer_size(fc, log);
+	fc.buffer_size = profile.buffer_size;
+	profile.io = tune_io(fc, log);
+	return profile;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static std::string host_name()
+{
+#ifdef _WIN32
+	const char* name = std::getenv("COMPUTERNAME");
+	return name ? name : "localhost";
+#else
+	char name[256] = {};
+	if (gethostname(name, sizeof(name) - 1))
+	{
+		return "localhost";
+	}
+	return name;
+#endif
+}
+
+static std::string profile_dir()
+{
+#ifdef _WIN32
+	const char* appdata = std::getenv("APPDATA");
+	return appdata ? std::string(appdata) + "\\des" : "";
+#else
+	const char* config = std::getenv("XDG_CONFIG_HOME");
+	if (config && *config)
+	{
+		return std::string(config) + "/des";
+	}
+	const char* home = std::getenv("HOME");
+	return home ? std::string(home) + "/.config/des" : "";
+#endif
+}
+
+/*
+Creates missing directories on the way to file fname, errors are left for opening of the file
+*/
+static void make_parent_dirs(const std::string& fname)
+{
+	for (size_t sep = fname.find_first_of("/\\", 1); sep != std::string::npos; sep = fname.find_first_of("/\\", sep + 1))
+	{
+		std::string dir = fname.substr(0, sep);
+#ifdef _WIN32
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+}
+
+std::string default_profile_path()
+{
+	std::string dir = profile_dir();
+#ifdef _WIN32
+	return dir.empty() ? "" : dir + "\\" + host_name() + ".profile";
+#else
+	return dir.empty() ? "" : dir + "/" + host_name() + ".profile";
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+const char* engine_name(int engine)
+{
+	return engine == File_Crypter::Table ? "table" : "reference";
+}
+
+int parse_engine(const std::string& name)
+{
+	if (name == "reference")
+	{
+		return File_Crypter::Reference;
+	}
+	if (name == "table")
+	{
+		return File_Crypter::Table;
+	}
+	return -1;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Profile is text file of key=value lines, lines starting with # are comments
+*/
+bool load_profile(const std::string& fname, Tuning_Profile& profile)
+{
+	std::ifstream ifs(fname);
+	if (!ifs)
+	{
+		return false;
+	}
+	Tuning_Profile loaded;
+	bool host_matches = false;
+	std::string line;
+	while (std::getline(ifs, line))
+	{
+		size_t eq = line.find('=');
+		if (line.empty() || line[0] == '#' || eq == std::string::npos)
+		{
+			continue;
+		}
+		std::string key = line.substr(0, eq);
+		std::string value = line.substr(eq + 1);
+		try
+		{
+			if (key == "host")
+			{
+				host_matches = value == host_name();
+			}
+			else if (key == "engine")
+			{
+				loaded.engine = parse_engine(value);
+			}
+			else if (key == "threads")
+			{
+				loaded.threads = std::stoi(value);
+			}
+			else if (key == "buffer_size")
+			{
+				loaded.buffer_size = std::stoi(value);
+			}
+			else if (key == "io")
+			{
+				loaded.io = parse_io(value);
+			}
+		}
+		catch (std::exception&)
+		{
+			return false;
+		}
+	}
+	if (!host_matches || loaded.engine < 0 || loaded.threads < 1 || loaded.buffer_size < BLOCKSIZE || loaded.io < 0)
+	{
+		return false;
+	}
+	profile = loaded;
+	return true;
+}
+
+bool save_profile(const std::string& fname, const Tuning_Profile& profile)
+{
+	make_parent_dirs(fname);
+	std::ofstream ofs(fname);
+	ofs << "# DES autotune profile, rewritten by --autotune\n";
+	ofs << "host=" << host_name() << "\n";
+	ofs << "engine=" << engine_name(profile.engine) << "\n";
+	ofs << "threads=" << profile.threads << "\n";
+	ofs << "buffer_size=" << profile.buffer_size << "\n";
+	ofs << "io=" << io_name(profile.io) << "\n";
+	return (bool)ofs;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include "DESFileCrypt.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Settings chosen by autotune for this host.
+threads - number of threads doing compute(calling thread included), 1 - singlethread mode.
+io - I/O backend of files, Io_Backends.
+*/
+struct Tuning_Profile
+{
+	int engine = File_Crypter::Reference;
+	int threads = 1;
+	int buffer_size = BUFSIZE;
+	int io = IO_STREAM;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Short calibration passes with keys, cipher and input file of crypter:
+engine - time of run_des for every engine,
+threads - in-memory workload split between pools of growing size, the smallest count within 5% of the best wins,
+buffer_size - reading and processing of the beginning of input file with chunks of different size,
+io - reading of the beginning of input file with every backend.
+Progress is printed into log.
+*/
+Tuning_Profile autotune(const File_Crypter& crypter, std::ostream& log);
+
+// ~/.config/des/<host>.profile(%APPDATA%\des\<host>.profile on Windows), empty if home is unknown
+std::string default_profile_path();
+// false if file is missing, malformed or was written on another host
+bool load_profile(const std::string& fname, Tuning_Profile& profile);
+// creates missing directories of the path, false if file could not be written
+bool save_profile(const std::string& fname, const Tuning_Profile& profile);
+
+const char* engine_name(int engine);
+// -1 if name is unknown
+int parse_engine(const std::string& name);
@@ -0,0 +1,283 @@
+#include "stdafx.h"
+#include "DESBatch.h"
+#include "DESTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+
+namespace fs = std::filesystem;
+
+typedef std::chrono::steady_clock batch_clock;
+
+static double seconds_since(batch_clock::time_point& start)
+{
+	batch_clock::time_point now = batch_clock::now();
+	double seconds = std::chrono::duration<double>(now - start).count();
+	start = now;
+	return seconds;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Part of one file in pack, size is padded to blocks
+*/
+struct Pack_Slice
+{
+	int item;
+	int offset;
+	int size;
+	bool first;
+	bool last;
+};
+
+struct Pack
+{
+	Pooled_Buffer buffer;
+	int bytes = 0;
+	std::vector<Pack_Slice> slices;
+	task_group tasks;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Batch_Crypter::Batch_Crypter(const File_Crypter& crypter_)
+	: crypter(crypter_)
+{
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+int Batch_Crypter::add_manifest(const std::string& fname)
+{
+	std::ifstream ifs(fname);
+	if (!ifs)
+	{
+		return -1;
+	}
+	std::vector<Batch_Item> added;
+	std::string line;
+	while (std::getline(ifs, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		size_t tab = line.find('\t');
+		if (tab == std::string::npos)
+		{
+			return -1;
+		}
+		Batch_Item item;
+		item.ifname = line.substr(0, tab);
+		item.ofname = line.substr(tab + 1);
+		added.push_back(item);
+	}
+	items.insert(items.end(), added.begin(), added.end());
+	return added.size();
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+int Batch_Crypter::add_tree(const std::string& in_dir, const std::string& out_dir)
+{
+	std::error_code ec;
+	if (!fs::is_directory(in_dir, ec))
+	{
+		return -1;
+	}
+	// output tree may be inside input tree, its files are not inputs
+	fs::path out_root = fs::weakly_canonical(out_dir, ec);
+	std::vector<Batch_Item> added;
+	for (fs::recursive_directory_iterator it(in_dir, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (it->is_directory(ec) && fs::weakly_canonical(it->path(), ec) == out_root)
+		{
+			it.disable_recursion_pending();
+			continue;
+		}
+		if (!it->is_regular_file(ec))
+		{
+			continue;
+		}
+		Batch_Item item;
+		item.ifname = it->path().string();
+		item.ofname = (fs::path(out_dir) / fs::relative(it->path(), in_dir, ec)).string();
+		added.push_back(item);
+	}
+	// sorted, so batch and its report don't depend on order of directory entries
+	std::sort(added.begin(), added.end(), [](const Batch_Item& a, const Batch_Item& b) { return a.ifname < b.ifname; });
+	for (const Batch_Item& item : added)
+	{
+		fs::create_directories(fs::path(item.ofname).parent_path(), ec);
+	}
+	items.insert(items.end(), added.begin(), added.end());
+	return added.size();
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+int Batch_Crypter::run()
+{
+	stats = Run_Stats{};
+	crypter.prepare_schedules();
+	std::optional<Pool_Executor> pool_executor;
+	if (!crypter.executor)
+	{
+		pool_executor.emplace(thread_pool ? *thread_pool : ThreadPoolMy::shared());
+	}
+	Executor& ex = crypter.executor ? *crypter.executor : *pool_executor;
+	const int chunk = std::max(BLOCKSIZE, crypter.buffer_size - crypter.buffer_size % BLOCKSIZE);
+	const size_t window = max_in_flight > 0 ? max_in_flight : 2 * ex.concurrency();
+	for (Batch_Item& item : items)
+	{
+		item.bytes = 0;
+		item.failed = false;
+		item.error.clear();
+	}
+
+	std::deque<std::unique_ptr<Pack>> in_flight;
+	// outputs of files, that are written by several packs
+	std::map<int, std::unique_ptr<Byte_Writer>> outputs;
+	batch_clock::time_point lap_start = batch_clock::now();
+
+	auto fail = [this](int item, const char* error)
+	{
+		items[item].failed = true;
+		items[item].error = error;
+	};
+
+	auto write_oldest = [&]()
+	{
+		std::unique_ptr<Pack> pack = std::move(in_flight.front());
+		in_flight.pop_front();
+		{
+			DES_TRACE_SPAN("wait");
+			ex.wait(pack->tasks);
+		}
+		stats.compute_seconds += seconds_since(lap_start);
+		for (const Pack_Slice& slice : pack->slices)
+		{
+			if (items[slice.item].failed)
+			{
+				outputs.erase(slice.item);
+				continue;
+			}
+			std::unique_ptr<Byte_Writer>& out = outputs[slice.item];
+			if (slice.first)
+			{
+				out = open_writer(items[slice.item].ofname, crypter.io);
+				if (!out)
+				{
+					fail(slice.item, "could not open output file");
+				}
+			}
+			if (out)
+			{
+				try
+				{
+					write_chunk(*out, pack->buffer.get() + slice.offset, slice.size);
+				}
+				catch (const std::runtime_error&)
+				{
+					fail(slice.item, "could not write output file");
+				}
+			}
+			if (slice.last || items[slice.item].failed)
+			{
+				outputs.erase(slice.item);
+			}
+		}
+		stats.write_seconds += seconds_since(lap_start);
+	};
+
+	std::unique_ptr<Byte_Reader> in;
+	int reading = -1;
+	bool first = false;
+	size_t next_item = 0;
+	while (true)
+	{
+		std::unique_ptr<Pack> pack(new Pack);
+		pack->buffer = Pooled_Buffer(chunk);
+		while (pack->bytes < chunk)
+		{
+			if (reading < 0)
+			{
+				if (next_item == items.size())
+				{
+					break;
+				}
+				in = open_reader(items[next_item].ifname, crypter.io);
+				if (!in)
+				{
+					fail(next_item++, "could not open input file");
+					continue;
+				}
+				reading = next_item++;
+				first = true;
+			}
+			int space = chunk - pack->bytes;
+			int got = 0;
+			try
+			{
+				got = read_chunk(*in, pack->buffer.get() + pack->bytes, space);
+			}
+			catch (const std::runtime_error&)
+			{
+				fail(reading, "could not read input file");
+			}
+			// reader fills the space unless input ends, file ending exactly here gets empty last slice in the next pack
+			bool last = got < space || items[reading].failed;
+			items[reading].bytes += got;
+			stats.bytes += got;
+			// empty file still gets its slice, so empty output is created
+			int padded = pad_to_blocks(pack->buffer.get() + pack->bytes, got);
+			pack->slices.push_back(Pack_Slice{ reading, pack->bytes, padded, first, last });
+			pack->bytes += padded;
+			first = false;
+			if (last)
+			{
+				in.reset();
+				reading = -1;
+			}
+		}
+		stats.read_seconds += seconds_since(lap_start);
+		if (pack->slices.empty())
+		{
+			break;
+		}
+
+		// calling thread keeps reading, it joins in wait for the oldest pack
+		int portions = crypter.adaptive ? crypter.parallel_portions(pack->bytes, ex.concurrency()) : ex.concurrency();
+		int portion_blocks = (pack->bytes / BLOCKSIZE + portions - 1) / portions;
+		char* buffer = pack->buffer.get();
+		int bytes = pack->bytes;
+		// pack of empty files only has no blocks
+		int count = portion_blocks ? (bytes / BLOCKSIZE + portion_blocks - 1) / portion_blocks : 0;
+		File_Crypter* fc = &crypter;
+		ex.start(count, [fc, buffer, bytes, portion_blocks](int i)
+		{
+			int offset = i * portion_blocks * BLOCKSIZE;
+			DES_TRACE_SPAN("run_des");
+			fc->run_des(buffer + offset, std::min(portion_blocks, (bytes - offset) / BLOCKSIZE));
+		}, pack->tasks);
+		in_flight.push_back(std::move(pack));
+		if (in_flight.size() >= window)
+		{
+			write_oldest();
+		}
+	}
+	while (!in_flight.empty())
+	{
+		write_oldest();
+	}
+	return std::count_if(items.begin(), items.end(), [](const Batch_Item& item) { return item.failed; });
+}
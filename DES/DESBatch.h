@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "DESFileCrypt.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+One input/output pair of batch with its result
+*/
+struct Batch_Item
+{
+	std::string ifname;
+	std::string ofname;
+	long long bytes = 0;
+	bool failed = false;
+	std::string error;
+};
+
+/*
+Processes many files with one pool and one key setting.
+Files are read one after another into packs of chunk size: big file gives pack per chunk,
+small files are packed together into one, so every pack is enough work for all threads.
+Calling thread reads next packs while pool processes previous ones and writes finished packs in order,
+at most max_in_flight packs are in memory at once. So at most one input and max_in_flight + 1 outputs are open.
+Errors of one file(can't open, can't write) don't stop the others.
+*/
+class Batch_Crypter
+{
+public:
+	// keys, mode, cipher, engine, buffer_size and executor are taken from crypter, its file names are ignored
+	explicit Batch_Crypter(const File_Crypter& crypter_);
+
+	std::vector<Batch_Item> items;
+	// pool for processing if crypter has no executor, ThreadPoolMy::shared() if not set
+	ThreadPoolMy* thread_pool = nullptr;
+	// 0 - two per thread of executor
+	int max_in_flight = 0;
+	// totals of the last run, compute time is time calling thread waited for packs
+	Run_Stats stats;
+
+	// lines "input_file<TAB>output_file", empty lines and lines starting with # are skipped
+	// returns number of added items or -1 if file can't be read or line has no tab
+	int add_manifest(const std::string& fname);
+	// every regular file of in_dir tree, output of in_dir/a/b is out_dir/a/b, directories are created
+	// returns number of added items or -1 if in_dir is not directory
+	int add_tree(const std::string& in_dir, const std::string& out_dir);
+	// returns number of failed items
+	int run();
+private:
+	File_Crypter crypter;
+};
@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "DESBuffer.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+
+// run_buffer takes int size, bigger buffers are processed in pieces of this size
+static const long long MAX_PIECE = INT_MAX / BLOCKSIZE / 2 * BLOCKSIZE;
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static File_Crypter des_keys(uint64_t key)
+{
+	File_Crypter fc;
+	fc.set_key(key);
+	return fc;
+}
+
+static File_Crypter triple_des_keys(uint64_t key1, uint64_t key2, uint64_t key3, int triple_des_mode)
+{
+	File_Crypter fc;
+	fc.set_3keys(key1, key2, key3);
+	fc.triple_des = true;
+	if (fc.set_triple_des_mode(triple_des_mode))
+	{
+		throw std::runtime_error("Cipher_Config(): Triple-DES mode must be EEE3 or EDE3");
+	}
+	return fc;
+}
+
+Cipher_Config::Cipher_Config(uint64_t key)
+	: Cipher_Config(des_keys(key))
+{
+}
+
+Cipher_Config::Cipher_Config(uint64_t key1, uint64_t key2, uint64_t key3, int triple_des_mode)
+	: Cipher_Config(triple_des_keys(key1, key2, key3, triple_des_mode))
+{
+}
+
+Cipher_Config::Cipher_Config(const File_Crypter& keys)
+	: base(keys)
+{
+	base.ifname.clear();
+	base.ofname.clear();
+	base.kname.clear();
+	base.reader = nullptr;
+	base.writer = nullptr;
+	base.node_pools = nullptr;
+	for (int mode : { File_Crypter::Decrypt, File_Crypter::Encrypt })
+	{
+		base.mode = mode;
+		schedules[mode] = std::make_shared<const std::vector<Key_Schedule>>(base.key_schedules());
+	}
+}
+
+File_Crypter Cipher_Config::crypter(int mode) const
+{
+	File_Crypter fc = base;
+	fc.mode = mode;
+	fc.schedules = schedules[mode];
+	fc.engine = engine;
+	fc.multithread = multithread;
+	fc.adaptive = adaptive;
+	fc.thread_pool = thread_pool;
+	fc.executor = executor;
+	return fc;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static long long run_in_place(std::span<std::byte> data, const Cipher_Config& config, int mode)
+{
+	if (data.size() % BLOCKSIZE)
+	{
+		return -1;
+	}
+	File_Crypter fc = config.crypter(mode);
+	char* buffer = reinterpret_cast<char*>(data.data());
+	for (long long offset = 0; offset < (long long)data.size(); offset += MAX_PIECE)
+	{
+		fc.run_buffer(buffer + offset, (int)std::min<long long>(MAX_PIECE, data.size() - offset));
+	}
+	return data.size();
+}
+
+static long long run_copy(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config, int mode)
+{
+	size_t padded = padded_size(in.size());
+	if (out.size() < padded)
+	{
+		return -1;
+	}
+	if (!in.empty() && out.data() != in.data())
+	{
+		memmove(out.data(), in.data(), in.size());
+	}
+	memset(out.data() + in.size(), 0, padded - in.size());
+	return run_in_place(out.first(padded), config, mode);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+long long encrypt(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config)
+{
+	return run_copy(in, out, config, File_Crypter::Encrypt);
+}
+
+long long decrypt(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config)
+{
+	return run_copy(in, out, config, File_Crypter::Decrypt);
+}
+
+long long encrypt(std::span<std::byte> data, const Cipher_Config& config)
+{
+	return run_in_place(data, config, File_Crypter::Encrypt);
+}
+
+long long decrypt(std::span<std::byte> data, const Cipher_Config& config)
+{
+	return run_in_place(data, config, File_Crypter::Decrypt);
+}
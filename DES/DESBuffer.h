@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+#include "DESFileCrypt.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Keys and settings of buffer API.
+Key schedules of both directions are expanded once in constructor, so encrypt and decrypt don't allocate
+(in multithread mode only tasks of the pool are).
+engine, multithread, adaptive, thread_pool and executor have the same meaning as in File_Crypter.
+*/
+class Cipher_Config
+{
+public:
+	// DES
+	explicit Cipher_Config(uint64_t key);
+	// Triple-DES, triple_des_mode - File_Crypter::EEE3 or File_Crypter::EDE3, std::runtime_error for other modes
+	Cipher_Config(uint64_t key1, uint64_t key2, uint64_t key3, int triple_des_mode);
+	// keys and cipher of crypter(for example, after read_keys)
+	explicit Cipher_Config(const File_Crypter& keys);
+
+	int engine = File_Crypter::Table;
+	bool multithread = false;
+	bool adaptive = true;
+	// pool for multithread mode, process-wide ThreadPoolMy::shared() is used if not set
+	ThreadPoolMy* thread_pool = nullptr;
+	// used instead of thread_pool if set
+	Executor* executor = nullptr;
+
+	// crypter of mode(File_Crypter::Encrypt or File_Crypter::Decrypt) with these keys and settings
+	File_Crypter crypter(int mode) const;
+private:
+	File_Crypter base;
+	// by mode: Decrypt, Encrypt
+	std::shared_ptr<const std::vector<Key_Schedule>> schedules[2];
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+// size of output for 'bytes' bytes of input: last block is padded with zeros
+inline size_t padded_size(size_t bytes)
+{
+	return (bytes + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE;
+}
+
+/*
+in is copied into out, padded with zeros to blocks and processed there(in and out may be the same memory).
+out must hold padded_size(in.size()) bytes.
+Returns number of bytes written, -1 if out is too small.
+*/
+long long encrypt(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config);
+long long decrypt(std::span<const std::byte> in, std::span<std::byte> out, const Cipher_Config& config);
+
+/*
+In place, size of data must be a multiple of BLOCKSIZE.
+Returns size of data, -1 if it is not whole blocks.
+*/
+long long encrypt(std::span<std::byte> data, const Cipher_Config& config);
+long long decrypt(std::span<std::byte> data, const Cipher_Config& config);
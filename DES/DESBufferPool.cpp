@@ -0,0 +1,401 @@
+#include "stdafx.h"
+#include "DESBufferPool.h"
+#include <new>
+#include <cstdlib>
+#include <memory>
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+// buffers of every class kept by thread for itself, before freelist
+static const int THREAD_CACHE_SIZE = 2;
+
+static size_t class_size(int cls)
+{
+	return (size_t)1 << (cls + Buffer_Pool::MIN_CLASS_BITS);
+}
+
+static const size_t NODE_ALIGNMENT = 64;
+
+/*
+Link of freelist, owned by pool and never given out, so it can be read by stale pop while another thread uses it.
+*/
+struct alignas(NODE_ALIGNMENT) Buffer_Pool::Free_Node
+{
+	std::atomic<Free_Node*> next{ nullptr };
+	char* buffer = nullptr;
+};
+
+#if defined(__x86_64__) || defined(_M_X64)
+// user space pointers fit into 48 bits(47 unless mmap is asked for higher addresses), top 16 bits are ABA tag
+static const int TAG_SHIFT = 48;
+static const uintptr_t POINTER_MASK = ((uintptr_t)1 << TAG_SHIFT) - 1;
+#else
+// low bits of pointer(zero due to alignment of nodes) are ABA tag
+static const int TAG_SHIFT = 0;
+static const uintptr_t POINTER_MASK = ~(uintptr_t)(NODE_ALIGNMENT - 1);
+#endif
+
+static uintptr_t next_tag(uintptr_t top)
+{
+	return (top + ((uintptr_t)1 << TAG_SHIFT)) & ~POINTER_MASK;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Per-thread cache of shared pool: acquire and release by the same thread don't touch shared freelist,
+and buffer stays on NUMA node of thread that touched it.
+Cached buffers go to freelist on thread exit.
+*/
+struct Thread_Buffer_Cache
+{
+	std::array<std::array<char*, THREAD_CACHE_SIZE>, Buffer_Pool::SIZE_CLASSES> buffers;
+	std::array<int, Buffer_Pool::SIZE_CLASSES> counts{};
+
+	~Thread_Buffer_Cache()
+	{
+		for (int cls = 0; cls < Buffer_Pool::SIZE_CLASSES; ++cls)
+		{
+			for (int i = 0; i < counts[cls]; ++i)
+			{
+				Buffer_Pool::shared().push(cls, buffers[cls][i]);
+			}
+		}
+	}
+};
+
+static Thread_Buffer_Cache& thread_buffer_cache()
+{
+	thread_local Thread_Buffer_Cache cache;
+	return cache;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Buffer_Pool::Buffer_Pool(bool huge_pages_, bool fresh_pages_)
+	: huge_pages{ huge_pages_ }, fresh_pages{ fresh_pages_ }
+{
+	for (int cls = 0; cls < SIZE_CLASSES; ++cls)
+	{
+		freelists[cls] = 0;
+		spare_nodes[cls] = 0;
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Buffer_Pool::~Buffer_Pool()
+{
+	trim();
+	for (int cls = 0; cls < SIZE_CLASSES; ++cls)
+	{
+		while (Free_Node* node = pop_node(spare_nodes[cls]))
+		{
+			delete node;
+		}
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Never destroyed: workers of static thread pools return their caches here on exit,
+that can happen after destruction of other statics.
+*/
+Buffer_Pool& Buffer_Pool::shared()
+{
+	static Buffer_Pool* pool = []()
+	{
+		Buffer_Pool* p = new Buffer_Pool;
+		p->thread_cache = true;
+		return p;
+	}();
+	return *pool;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Index of power of two class for size, -1 if size is too big for pooling
+*/
+int Buffer_Pool::size_class(size_t size)
+{
+	int cls = 0;
+	while (cls < SIZE_CLASSES && class_size(cls) < size)
+	{
+		++cls;
+	}
+	return cls < SIZE_CLASSES ? cls : -1;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+size_t Buffer_Pool::allocation_size(int cls, size_t size)
+{
+	return cls < 0 ? (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT : class_size(cls);
+}
+
+/*
+Anonymous mapping of 'bytes' bytes aligned to alignment, nullptr on failure.
+Mapping is made bigger by alignment and cut to aligned part.
+*/
+static void* map_pages(size_t bytes, size_t alignment)
+{
+#ifdef _WIN32
+	// VirtualAlloc regions are aligned to 64 KB only, huge alignment is not kept
+	(void)alignment;
+	return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	size_t extra = alignment > Buffer_Pool::ALIGNMENT ? alignment : 0;
+	void* mapped = mmap(nullptr, bytes + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapped == MAP_FAILED)
+	{
+		return nullptr;
+	}
+	char* start = static_cast<char*>(mapped);
+	char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(start) + alignment - 1) / alignment * alignment);
+	if (aligned > start)
+	{
+		munmap(start, aligned - start);
+	}
+	if (start + bytes + extra > aligned + bytes)
+	{
+		munmap(aligned + bytes, start + bytes + extra - (aligned + bytes));
+	}
+	return aligned;
+#endif
+}
+
+/*
+Pooled buffer comes with spare node, so release finds one without allocation
+*/
+char* Buffer_Pool::allocate(int cls, size_t size)
+{
+	std::unique_ptr<Free_Node> node(cls < 0 ? nullptr : new Free_Node);
+	size_t bytes = allocation_size(cls, size);
+	bool huge = huge_pages && bytes >= HUGE_PAGE_SIZE;
+	size_t alignment = huge ? HUGE_PAGE_SIZE : ALIGNMENT;
+	void* buffer = nullptr;
+	if (fresh_pages)
+	{
+		buffer = map_pages(bytes, alignment);
+	}
+	else
+	{
+#ifdef _WIN32
+		buffer = _aligned_malloc(bytes, alignment);
+#else
+		if (posix_memalign(&buffer, alignment, bytes))
+		{
+			buffer = nullptr;
+		}
+#endif
+	}
+	if (!buffer)
+	{
+		throw std::bad_alloc();
+	}
+#ifdef MADV_HUGEPAGE
+	if (huge)
+	{
+		madvise(buffer, bytes, MADV_HUGEPAGE);
+	}
+#endif
+	if (node)
+	{
+		push_node(spare_nodes[cls], node.release());
+	}
+	++allocated;
+	return static_cast<char*>(buffer);
+}
+
+void Buffer_Pool::deallocate(char* buffer, size_t bytes)
+{
+	if (fresh_pages)
+	{
+#ifdef _WIN32
+		VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+		munmap(buffer, bytes);
+#endif
+		return;
+	}
+#ifdef _WIN32
+	_aligned_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Treiber stacks of nodes: free buffers of class are held by nodes of freelist, nodes without buffers wait in spare_nodes.
+Links aren't kept in free buffers themselves, pop could read them while buffer is already written by thread
+that popped it. Nodes are freed only by destructor, so stale pop reads valid atomic link.
+Tag is incremented on every change of top, so pop can't succeed with stale next
+if top was popped and pushed back meanwhile(ABA). It is 16 bits on x86-64 and only 6 bits(alignment of nodes) elsewhere,
+so pop stalled between reading top and its CAS for exactly multiple of 65536(64) changes of top could still corrupt stack.
+*/
+void Buffer_Pool::push_node(std::atomic<uintptr_t>& stack, Free_Node* node)
+{
+	uintptr_t top = stack.load(std::memory_order_relaxed);
+	do
+	{
+		node->next.store(reinterpret_cast<Free_Node*>(top & POINTER_MASK), std::memory_order_relaxed);
+	} while (!stack.compare_exchange_weak(top, reinterpret_cast<uintptr_t>(node) | next_tag(top), std::memory_order_release, std::memory_order_relaxed));
+}
+
+Buffer_Pool::Free_Node* Buffer_Pool::pop_node(std::atomic<uintptr_t>& stack)
+{
+	uintptr_t top = stack.load(std::memory_order_acquire);
+	while (top & POINTER_MASK)
+	{
+		Free_Node* node = reinterpret_cast<Free_Node*>(top & POINTER_MASK);
+		uintptr_t next = reinterpret_cast<uintptr_t>(node->next.load(std::memory_order_relaxed));
+		if (stack.compare_exchange_weak(top, next | next_tag(top), std::memory_order_acquire, std::memory_order_acquire))
+		{
+			return node;
+		}
+	}
+	return nullptr;
+}
+
+void Buffer_Pool::push(int cls, char* buffer)
+{
+	Free_Node* node = pop_node(spare_nodes[cls]);
+	if (!node)
+	{
+		// spare nodes of concurrent pops aren't pushed back yet
+		node = new Free_Node;
+	}
+	node->buffer = buffer;
+	push_node(freelists[cls], node);
+}
+
+char* Buffer_Pool::pop(int cls)
+{
+	Free_Node* node = pop_node(freelists[cls]);
+	if (!node)
+	{
+		return nullptr;
+	}
+	char* buffer = node->buffer;
+	push_node(spare_nodes[cls], node);
+	return buffer;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+char* Buffer_Pool::acquire(size_t size)
+{
+	int cls = size_class(size);
+	if (cls < 0)
+	{
+		return allocate(cls, size);
+	}
+	if (thread_cache)
+	{
+		Thread_Buffer_Cache& cache = thread_buffer_cache();
+		if (cache.counts[cls])
+		{
+			++reused;
+			return cache.buffers[cls][--cache.counts[cls]];
+		}
+	}
+	char* buffer = pop(cls);
+	if (buffer)
+	{
+		++reused;
+		return buffer;
+	}
+	return allocate(cls, size);
+}
+
+void Buffer_Pool::release(char* buffer, size_t size)
+{
+	int cls = size_class(size);
+	if (cls < 0)
+	{
+		deallocate(buffer, allocation_size(cls, size));
+		return;
+	}
+	if (thread_cache)
+	{
+		Thread_Buffer_Cache& cache = thread_buffer_cache();
+		if (cache.counts[cls] < THREAD_CACHE_SIZE)
+		{
+			cache.buffers[cls][cache.counts[cls]++] = buffer;
+			return;
+		}
+	}
+	push(cls, buffer);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void Buffer_Pool::trim()
+{
+	for (int cls = 0; cls < SIZE_CLASSES; ++cls)
+	{
+		while (char* buffer = pop(cls))
+		{
+			deallocate(buffer, class_size(cls));
+		}
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Buffer_Pool_Stats Buffer_Pool::stats() const
+{
+	Buffer_Pool_Stats st;
+	st.allocated = allocated.load();
+	st.reused = reused.load();
+	return st;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Pooled_Buffer::Pooled_Buffer(size_t size_, Buffer_Pool& pool_)
+	: pool{ &pool_ }, buffer{ pool_.acquire(size_) }, _size{ size_ }
+{
+}
+
+Pooled_Buffer::Pooled_Buffer(Pooled_Buffer&& other)
+	: pool{ other.pool }, buffer{ other.buffer }, _size{ other._size }
+{
+	other.buffer = nullptr;
+}
+
+Pooled_Buffer& Pooled_Buffer::operator=(Pooled_Buffer&& other)
+{
+	if (this != &other)
+	{
+		reset();
+		pool = other.pool;
+		buffer = other.buffer;
+		_size = other._size;
+		other.buffer = nullptr;
+	}
+	return *this;
+}
+
+Pooled_Buffer::~Pooled_Buffer()
+{
+	reset();
+}
+
+void Pooled_Buffer::reset()
+{
+	if (buffer)
+	{
+		pool->release(buffer, _size);
+		buffer = nullptr;
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+struct Buffer_Pool_Stats
+{
+	// buffers taken from system
+	uint64_t allocated = 0;
+	// buffers given out again from freelist or thread cache
+	uint64_t reused = 0;
+};
+
+/*
+Pool of page-aligned chunk buffers.
+Sizes are rounded up to power of two(4 KB at least), every size class has lock-free freelist,
+so buffers are recycled between runs instead of being allocated and page-faulted again.
+Buffers of 2 MB and more are aligned to 2 MB and marked for transparent huge pages(Linux) if huge_pages is set.
+With fresh_pages buffers are mapped from system directly instead of heap, so their pages were never touched
+and are placed on NUMA node of thread that touches them first(see Node_Pools).
+Buffers are returned to system only by trim() and destructor, all of them must be released before destruction.
+Process-wide pool shared() also keeps few buffers of every class in per-thread caches.
+*/
+class Buffer_Pool
+{
+public:
+	static const size_t ALIGNMENT = 4096;
+	static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	explicit Buffer_Pool(bool huge_pages = true, bool fresh_pages = false);
+	Buffer_Pool(const Buffer_Pool&) = delete;
+	Buffer_Pool& operator=(const Buffer_Pool&) = delete;
+	~Buffer_Pool();
+	static Buffer_Pool& shared();
+
+	// at least size bytes, aligned to ALIGNMENT
+	char* acquire(size_t size);
+	// size must be the same as in acquire
+	void release(char* buffer, size_t size);
+	// frees buffers of freelists(not of thread caches)
+	void trim();
+	Buffer_Pool_Stats stats() const;
+
+	static const int MIN_CLASS_BITS = 12;
+	static const int SIZE_CLASSES = 15;	// 4 KB .. 64 MB, bigger buffers are not pooled
+private:
+	bool huge_pages;
+	bool fresh_pages;
+	bool thread_cache = false;
+	struct Free_Node;
+	// tops of stacks of nodes holding free buffers and of spare nodes, tagged pointers(see push)
+	std::array<std::atomic<uintptr_t>, SIZE_CLASSES> freelists;
+	std::array<std::atomic<uintptr_t>, SIZE_CLASSES> spare_nodes;
+	std::atomic<uint64_t> allocated{ 0 };
+	std::atomic<uint64_t> reused{ 0 };
+
+	static int size_class(size_t size);
+	char* allocate(int cls, size_t size);
+	static size_t allocation_size(int cls, size_t size);
+	void deallocate(char* buffer, size_t bytes);
+	static void push_node(std::atomic<uintptr_t>& stack, Free_Node* node);
+	static Free_Node* pop_node(std::atomic<uintptr_t>& stack);
+	void push(int cls, char* buffer);
+	char* pop(int cls);
+	friend struct Thread_Buffer_Cache;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Buffer of Buffer_Pool, returned to pool on destruction
+*/
+class Pooled_Buffer
+{
+public:
+	Pooled_Buffer() = default;
+	explicit Pooled_Buffer(size_t size_, Buffer_Pool& pool_ = Buffer_Pool::shared());
+	Pooled_Buffer(Pooled_Buffer&& other);
+	Pooled_Buffer& operator=(Pooled_Buffer&& other);
+	~Pooled_Buffer();
+	void reset();
+	inline char* get() const { return buffer; }
+	inline size_t size() const { return _size; }
+private:
+	Buffer_Pool* pool = nullptr;
+	char* buffer = nullptr;
+	size_t _size = 0;
+};
@@ -0,0 +1,118 @@
+#include "stdafx.h"
+#include "DESCheckpoint.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+bool save_checkpoint(const std::string& fname, const Checkpoint& checkpoint)
+{
+	const std::string tmp = fname + ".tmp";
+	{
+		std::ofstream ofs(tmp);
+		ofs << "# DES checkpoint\n";
+		ofs << "mode=" << checkpoint.mode << "\n";
+		ofs << "cipher=" << checkpoint.cipher << "\n";
+		ofs << "key_check=" << std::hex << checkpoint.key_check << std::dec << "\n";
+		ofs << "input_bytes=" << checkpoint.input_bytes << "\n";
+		ofs << "input_time=" << checkpoint.input_time << "\n";
+		ofs << "done_chunks=" << checkpoint.done_chunks << "\n";
+		ofs << "input_offset=" << checkpoint.input_offset << "\n";
+		ofs << "output_offset=" << checkpoint.output_offset << "\n";
+		for (const Checked_Range& range : checkpoint.tail)
+		{
+			ofs << "tail=" << range.offset << " " << range.size << " " << std::hex << range.hash << std::dec << "\n";
+		}
+		if (!ofs)
+		{
+			return false;
+		}
+	}
+	std::error_code ec;
+	fs::rename(tmp, fname, ec);
+	return !ec;
+}
+
+bool load_checkpoint(const std::string& fname, Checkpoint& checkpoint)
+{
+	std::ifstream ifs(fname);
+	if (!ifs)
+	{
+		return false;
+	}
+	checkpoint = Checkpoint{};
+	int found = 0;
+	std::string line;
+	while (std::getline(ifs, line))
+	{
+		size_t eq = line.find('=');
+		if (line.empty() || line[0] == '#' || eq == std::string::npos)
+		{
+			continue;
+		}
+		std::string key = line.substr(0, eq);
+		std::string value = line.substr(eq + 1);
+		try
+		{
+			if (key == "mode")
+			{
+				checkpoint.mode = std::stoi(value);
+				found |= 1;
+			}
+			else if (key == "cipher")
+			{
+				checkpoint.cipher = std::stoi(value);
+				found |= 2;
+			}
+			else if (key == "key_check")
+			{
+				checkpoint.key_check = (uint32_t)std::stoul(value, nullptr, 16);
+				found |= 4;
+			}
+			else if (key == "input_bytes")
+			{
+				checkpoint.input_bytes = std::stoll(value);
+				found |= 8;
+			}
+			else if (key == "input_time")
+			{
+				checkpoint.input_time = std::stoll(value);
+				found |= 16;
+			}
+			else if (key == "done_chunks")
+			{
+				checkpoint.done_chunks = std::stoll(value);
+				found |= 32;
+			}
+			else if (key == "input_offset")
+			{
+				checkpoint.input_offset = std::stoll(value);
+				found |= 64;
+			}
+			else if (key == "output_offset")
+			{
+				checkpoint.output_offset = std::stoll(value);
+				found |= 128;
+			}
+			else if (key == "tail")
+			{
+				Checked_Range range;
+				std::istringstream iss(value);
+				if (!(iss >> range.offset >> range.size >> std::hex >> range.hash))
+				{
+					return false;
+				}
+				checkpoint.tail.push_back(range);
+			}
+		}
+		catch (std::exception&)
+		{
+			return false;
+		}
+	}
+	return found == 255;
+}
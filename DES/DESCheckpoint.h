@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Written chunk of output kept in checkpoint to verify output before resuming
+*/
+struct Checked_Range
+{
+	long long offset = 0;
+	int size = 0;
+	uint64_t hash = 0;
+};
+
+/*
+Checkpoint of File_Crypter::run: setting, input it was made for and how far output is written.
+Chunks are written in order of file(workers finish portions of chunk in any order, but chunk is written after all of them),
+so completed chunks are always the prefix done_chunks, input_offset and output_offset are where it ends.
+tail - the last written chunks, read back and compared before resuming.
+*/
+struct Checkpoint
+{
+	int mode = 0;
+	int cipher = 0;
+	uint32_t key_check = 0;
+	long long input_bytes = 0;
+	// modification time of input
+	long long input_time = 0;
+	long long done_chunks = 0;
+	long long input_offset = 0;
+	long long output_offset = 0;
+	std::vector<Checked_Range> tail;
+};
+
+// chunks kept in Checkpoint::tail
+const int CHECKPOINT_TAIL = 4;
+
+/*
+key=value lines, tail range per line: "tail=offset size hash".
+Saved into temporary file and renamed, so checkpoint is either the old one or the whole new one.
+*/
+bool save_checkpoint(const std::string& fname, const Checkpoint& checkpoint);
+// false if file is missing or malformed
+bool load_checkpoint(const std::string& fname, Checkpoint& checkpoint);
@@ -0,0 +1,379 @@
+#include "stdafx.h"
+#include "DESChecksum.h"
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#define DES_HAS_SSE42_CRC
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define DES_HAS_SSE42_CRC
+#endif
+
+
+// reflected polynomial of CRC32C
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+const char* checksum_name(int kind)
+{
+	switch (kind)
+	{
+	case CHECKSUM_CRC32C:
+		return "crc32c";
+	case CHECKSUM_XXH64:
+		return "xxh64";
+	default:
+		return "none";
+	}
+}
+
+int parse_checksum(const std::string& name)
+{
+	if (name == "none")
+	{
+		return NO_CHECKSUM;
+	}
+	if (name == "crc32c")
+	{
+		return CHECKSUM_CRC32C;
+	}
+	if (name == "xxh64")
+	{
+		return CHECKSUM_XXH64;
+	}
+	return -1;
+}
+
+/*--------------------------------------------------CRC32C-----------------------------------------------*/
+
+static std::array<uint32_t, 256> make_crc32c_table()
+{
+	std::array<uint32_t, 256> table;
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+		}
+		table[i] = crc;
+	}
+	return table;
+}
+
+static uint32_t crc32c_software(uint32_t crc, const char* data, size_t size)
+{
+	static const std::array<uint32_t, 256> table = make_crc32c_table();
+	for (size_t i = 0; i < size; ++i)
+	{
+		crc = table[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#ifdef DES_HAS_SSE42_CRC
+#if !defined(_MSC_VER)
+__attribute__((target("sse4.2")))
+#endif
+static uint32_t crc32c_sse42(uint32_t crc, const char* data, size_t size)
+{
+	uint64_t crc64 = crc;
+	for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = (uint32_t)crc64;
+	for (; size; --size, ++data)
+	{
+		crc = _mm_crc32_u8(crc, (unsigned char)*data);
+	}
+	return crc;
+}
+
+static bool detect_sse42()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+#endif
+}
+#endif
+
+bool crc32c_hardware()
+{
+#ifdef DES_HAS_SSE42_CRC
+	static const bool has_sse42 = detect_sse42();
+	return has_sse42;
+#else
+	return false;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const char* data, size_t size)
+{
+	crc = ~crc;
+#ifdef DES_HAS_SSE42_CRC
+	if (crc32c_hardware())
+	{
+		return ~crc32c_sse42(crc, data, size);
+	}
+#endif
+	return ~crc32c_software(crc, data, size);
+}
+
+/*
+CRC of zeros appended to crc1 is multiplication by matrix over GF(2), squared for every bit of len2(as in zlib)
+*/
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+	for (; vec; vec >>= 1, ++mat)
+	{
+		if (vec & 1)
+		{
+			sum ^= *mat;
+		}
+	}
+	return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat)
+{
+	for (int n = 0; n < 32; ++n)
+	{
+		square[n] = gf2_matrix_times(mat, mat[n]);
+	}
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, long long len2)
+{
+	if (len2 <= 0)
+	{
+		return crc1;
+	}
+	uint32_t even[32];
+	uint32_t odd[32];
+	// operator for one zero bit
+	odd[0] = CRC32C_POLY;
+	for (int n = 1; n < 32; ++n)
+	{
+		odd[n] = 1u << (n - 1);
+	}
+	gf2_matrix_square(even, odd);	// two zero bits
+	gf2_matrix_square(odd, even);	// four zero bits
+	do
+	{
+		gf2_matrix_square(even, odd);
+		if (len2 & 1)
+		{
+			crc1 = gf2_matrix_times(even, crc1);
+		}
+		len2 >>= 1;
+		if (!len2)
+		{
+			break;
+		}
+		gf2_matrix_square(odd, even);
+		if (len2 & 1)
+		{
+			crc1 = gf2_matrix_times(odd, crc1);
+		}
+		len2 >>= 1;
+	} while (len2);
+	return crc1 ^ crc2;
+}
+
+/*--------------------------------------------------XXH64------------------------------------------------*/
+
+static const uint64_t XXH_P1 = 11400714785074694791ULL;
+static const uint64_t XXH_P2 = 14029467366897019727ULL;
+static const uint64_t XXH_P3 = 1609587929392839161ULL;
+static const uint64_t XXH_P4 = 9650029242287828579ULL;
+static const uint64_t XXH_P5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const char* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_P2;
+	return rotl64(acc, 31) * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh_round(0, val);
+	return acc * XXH_P1 + XXH_P4;
+}
+
+/*
+XXH64 of little endian host
+*/
+uint64_t xxh64(const char* data, size_t size, uint64_t seed)
+{
+	const char* end = data + size;
+	uint64_t h;
+	if (size >= 32)
+	{
+		uint64_t v1 = seed + XXH_P1 + XXH_P2;
+		uint64_t v2 = seed + XXH_P2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - XXH_P1;
+		for (; end - data >= 32; data += 32)
+		{
+			v1 = xxh_round(v1, read64(data));
+			v2 = xxh_round(v2, read64(data + 8));
+			v3 = xxh_round(v3, read64(data + 16));
+			v4 = xxh_round(v4, read64(data + 24));
+		}
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxh_merge(h, v1);
+		h = xxh_merge(h, v2);
+		h = xxh_merge(h, v3);
+		h = xxh_merge(h, v4);
+	}
+	else
+	{
+		h = seed + XXH_P5;
+	}
+	h += size;
+	for (; end - data >= 8; data += 8)
+	{
+		h ^= xxh_round(0, read64(data));
+		h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+	}
+	if (end - data >= 4)
+	{
+		uint32_t v;
+		memcpy(&v, data, sizeof(v));
+		h ^= (uint64_t)v * XXH_P1;
+		h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+		data += 4;
+	}
+	for (; data < end; ++data)
+	{
+		h ^= (unsigned char)*data * XXH_P5;
+		h = rotl64(h, 11) * XXH_P1;
+	}
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	return h;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+uint64_t Stream_Checksum::leaf(const char* data, int size) const
+{
+	switch (kind)
+	{
+	case CHECKSUM_CRC32C:
+		return crc32c(0, data, size);
+	case CHECKSUM_XXH64:
+		return xxh64(data, size, 0);
+	default:
+		return 0;
+	}
+}
+
+void Stream_Checksum::add(uint64_t leaf_value, int size)
+{
+	if (kind == CHECKSUM_CRC32C)
+	{
+		total = crc32c_combine((uint32_t)total, (uint32_t)leaf_value, size);
+	}
+	else if (kind == CHECKSUM_XXH64)
+	{
+		total = xxh64(reinterpret_cast<const char*>(&leaf_value), sizeof(leaf_value), total);
+	}
+	_bytes += size;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static std::string to_hex(uint64_t value, int kind)
+{
+	std::ostringstream oss;
+	oss << std::hex << std::setfill('0') << std::setw(kind == CHECKSUM_CRC32C ? 8 : 16) << value;
+	return oss.str();
+}
+
+bool save_checksums(const std::string& fname, const Stream_Checksum& input, const Stream_Checksum& output)
+{
+	std::ofstream ofs(fname);
+	ofs << "# DES checksums of input and output\n";
+	ofs << "algorithm=" << checksum_name(input.kind) << "\n";
+	ofs << "input_bytes=" << input.bytes() << "\n";
+	ofs << "input=" << to_hex(input.value(), input.kind) << "\n";
+	ofs << "output_bytes=" << output.bytes() << "\n";
+	ofs << "output=" << to_hex(output.value(), output.kind) << "\n";
+	return (bool)ofs;
+}
+
+bool load_checksums(const std::string& fname, int& kind, uint64_t& input, uint64_t& output)
+{
+	std::ifstream ifs(fname);
+	if (!ifs)
+	{
+		return false;
+	}
+	int found = 0;
+	std::string line;
+	while (std::getline(ifs, line))
+	{
+		size_t eq = line.find('=');
+		if (line.empty() || line[0] == '#' || eq == std::string::npos)
+		{
+			continue;
+		}
+		std::string key = line.substr(0, eq);
+		std::string value = line.substr(eq + 1);
+		try
+		{
+			if (key == "algorithm")
+			{
+				kind = parse_checksum(value);
+				found |= kind > NO_CHECKSUM ? 1 : 0;
+			}
+			else if (key == "input")
+			{
+				input = std::stoull(value, nullptr, 16);
+				found |= 2;
+			}
+			else if (key == "output")
+			{
+				output = std::stoull(value, nullptr, 16);
+				found |= 4;
+			}
+		}
+		catch (std::exception&)
+		{
+			return false;
+		}
+	}
+	return found == 7;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+enum Checksum_Kinds { NO_CHECKSUM, CHECKSUM_CRC32C, CHECKSUM_XXH64 };
+
+const char* checksum_name(int kind);
+// -1 if name is unknown
+int parse_checksum(const std::string& name);
+
+// leaves of stream are checksummed independently(so in parallel) and folded in order
+const int CHECKSUM_LEAF = 64 * 1024;
+
+// CRC32C(Castagnoli), SSE4.2 instruction where CPU has it
+uint32_t crc32c(uint32_t crc, const char* data, size_t size);
+// CRC32C of concatenation from CRC32C of parts, len2 - size of the second part
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, long long len2);
+bool crc32c_hardware();
+uint64_t xxh64(const char* data, size_t size, uint64_t seed);
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Checksum of stream made of leaves: leaf() is value of one leaf(can be computed by any thread),
+add() folds values of leaves in order of stream.
+crc32c - CRC32C of the whole stream(the same as of file, so can be checked by other tools),
+xxh64 - chain of XXH64 of leaves: value = XXH64(leaf value, seed = value).
+*/
+class Stream_Checksum
+{
+public:
+	explicit Stream_Checksum(int kind_ = NO_CHECKSUM) : kind{ kind_ } {}
+	uint64_t leaf(const char* data, int size) const;
+	void add(uint64_t leaf_value, int size);
+	inline uint64_t value() const { return total; }
+	inline long long bytes() const { return _bytes; }
+
+	int kind;
+private:
+	uint64_t total = 0;
+	long long _bytes = 0;
+};
+
+/*
+Sidecar file of checksums, key=value lines:
+algorithm, input and output bytes, input and output checksums in hex.
+*/
+bool save_checksums(const std::string& fname, const Stream_Checksum& input, const Stream_Checksum& output);
+// false if file is missing or malformed
+bool load_checksums(const std::string& fname, int& kind, uint64_t& input, uint64_t& output);
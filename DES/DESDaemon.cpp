@@ -0,0 +1,511 @@
+#include "stdafx.h"
+#include "DESDaemon.h"
+#include <cstring>
+#include <sstream>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+
+static const uint32_t DAEMON_MAGIC = 0x44455344;	// "DESD"
+// read_keys takes 3 keys at most
+static const int KEY_FILE_MAX = 3 * sizeof(uint64_t);
+// inline buffers bigger than this should go as files or descriptors
+static const uint64_t MAX_INLINE_BYTES = 256ull * 1024 * 1024;
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Key_Cache::Key_Cache(size_t capacity_)
+	: capacity{ capacity_ ? capacity_ : 1 }
+{
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+std::shared_ptr<const File_Crypter> Key_Cache::get(const std::string& kname, int cipher, int mode, int engine, std::string& error)
+{
+	// key file is read once per request: id is made of its contents, crypter of the same bytes,
+	// so key file rewritten in any way(even within the same second) is never taken for the old one
+	std::string contents;
+	{
+		std::ifstream ifs(kname, std::ios_base::binary);
+		if (!ifs)
+		{
+			error = "could not read keys";
+			return nullptr;
+		}
+		char buffer[KEY_FILE_MAX];
+		ifs.read(buffer, KEY_FILE_MAX);
+		contents.assign(buffer, (size_t)ifs.gcount());
+	}
+	std::string id = kname + "|" + std::to_string(contents.size()) + "|" + std::to_string(xxh64(contents.data(), contents.size(), 0))
+		+ "|" + std::to_string(cipher) + "|" + std::to_string(mode) + "|" + std::to_string(engine);
+	{
+		std::lock_guard<std::mutex> lck{ mtx };
+		auto it = index.find(id);
+		if (it != index.end())
+		{
+			lru.splice(lru.begin(), lru, it->second);
+			++_hits;
+			return it->second->second;
+		}
+	}
+	++_misses;
+
+	std::shared_ptr<File_Crypter> fc = std::make_shared<File_Crypter>();
+	fc->kname = kname;
+	std::istringstream keys(contents);
+	if (fc->read_keys(keys))
+	{
+		error = "could not read keys";
+		return nullptr;
+	}
+	fc->triple_des = cipher != 0;
+	if (fc->triple_des && fc->keys_size() != 3)
+	{
+		error = "Triple-DES was requested, but key file has not enough keys";
+		return nullptr;
+	}
+	fc->set_triple_des_mode(cipher == 2 ? File_Crypter::EDE3 : File_Crypter::EEE3);
+	fc->mode = mode;
+	fc->engine = engine;
+	fc->schedules = std::make_shared<const std::vector<Key_Schedule>>(fc->key_schedules());
+
+	std::lock_guard<std::mutex> lck{ mtx };
+	if (index.find(id) == index.end())
+	{
+		lru.emplace_front(id, fc);
+		index[id] = lru.begin();
+		if (lru.size() > capacity)
+		{
+			index.erase(lru.back().first);
+			lru.pop_back();
+		}
+	}
+	return fc;
+}
+
+size_t Key_Cache::size()
+{
+	std::lock_guard<std::mutex> lck{ mtx };
+	return lru.size();
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+DES_Daemon::DES_Daemon(ThreadPoolMy& pool_, size_t cache_capacity)
+	: cache(cache_capacity), pool(pool_)
+{
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Processes one request with crypter from cache on the pool
+*/
+Daemon_Response DES_Daemon::handle(const Daemon_Request& request)
+{
+	Daemon_Response response;
+	if (request.op != File_Crypter::Encrypt && request.op != File_Crypter::Decrypt)
+	{
+		response.status = 1;
+		response.message = "unknown operation";
+		return response;
+	}
+	std::shared_ptr<const File_Crypter> cached = cache.get(request.kname, request.cipher, request.op, engine, response.message);
+	if (!cached)
+	{
+		response.status = 1;
+		return response;
+	}
+	File_Crypter fc = *cached;
+	fc.multithread = true;
+	fc.thread_pool = &pool;
+	fc.buffer_size = buffer_size;
+	try
+	{
+		if (request.kind == Daemon_Request::Buffer)
+		{
+			response.data = request.data;
+			int bytes = (response.data.size() + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE;
+			response.data.resize(bytes, 0);
+			fc.run_buffer(response.data.data(), bytes);
+			response.bytes = request.data.size();
+			return response;
+		}
+		std::unique_ptr<Byte_Reader> fd_reader;
+		std::unique_ptr<Byte_Writer> fd_writer;
+#ifndef _WIN32
+		if (request.kind == Daemon_Request::Fds)
+		{
+			// descriptors of client are used as they are, so its pipes and sockets work too
+			fd_reader.reset(new Fd_Reader(request.in_fd, false));
+			fd_writer.reset(new Fd_Writer(request.out_fd, false));
+			fc.reader = fd_reader.get();
+			fc.writer = fd_writer.get();
+		}
+		else
+#endif
+		{
+			fc.ifname = request.ifname;
+			fc.ofname = request.ofname;
+		}
+		if (fc.run())
+		{
+			response.status = 1;
+			response.message = "could not open, read or write file";
+		}
+		response.bytes = fc.stats.bytes;
+	}
+	catch (std::exception& err)
+	{
+		response.status = 1;
+		response.message = err.what();
+	}
+	return response;
+}
+
+#ifndef _WIN32
+/*-------------------------------------------------------------------------------------------------------*/
+
+static bool send_all(int fd, const char* data, size_t size)
+{
+	while (size)
+	{
+		ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+		if (sent <= 0)
+		{
+			return false;
+		}
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+static bool recv_all(int fd, char* data, size_t size)
+{
+	while (size)
+	{
+		ssize_t got = recv(fd, data, size, 0);
+		if (got <= 0)
+		{
+			return false;
+		}
+		data += got;
+		size -= got;
+	}
+	return true;
+}
+
+/*
+Message is built in memory: fields in host byte order(both sides are on the same host),
+strings and buffers with length before them.
+*/
+struct Message_Writer
+{
+	std::vector<char> bytes;
+
+	template<typename T>
+	void put(T value)
+	{
+		const char* p = reinterpret_cast<const char*>(&value);
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+	}
+	void put_bytes(const char* data, uint64_t size)
+	{
+		put(size);
+		bytes.insert(bytes.end(), data, data + size);
+	}
+	void put_string(const std::string& s)
+	{
+		put_bytes(s.data(), s.size());
+	}
+};
+
+template<typename T>
+static bool get(int fd, T& value)
+{
+	return recv_all(fd, reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+static bool get_bytes(int fd, std::vector<char>& data, uint64_t max_size)
+{
+	uint64_t size;
+	if (!get(fd, size) || size > max_size)
+	{
+		return false;
+	}
+	data.resize(size);
+	return recv_all(fd, data.data(), size);
+}
+
+static bool get_string(int fd, std::string& s)
+{
+	std::vector<char> data;
+	if (!get_bytes(fd, data, 64 * 1024))
+	{
+		return false;
+	}
+	s.assign(data.begin(), data.end());
+	return true;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Header(magic, op, kind, cipher) is received with recvmsg, descriptors come with it
+*/
+static bool read_request(int fd, Daemon_Request& request)
+{
+	char header[8];
+	char control[CMSG_SPACE(2 * sizeof(int))];
+	iovec iov{ header, sizeof(header) };
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	ssize_t got = recvmsg(fd, &msg, MSG_WAITALL);
+	// descriptors are taken even from broken request, so they are closed
+	for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+		{
+			int fds[2];
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+			request.in_fd = fds[0];
+			request.out_fd = fds[1];
+		}
+	}
+	if (got != sizeof(header))
+	{
+		return false;
+	}
+	uint32_t magic;
+	memcpy(&magic, header, sizeof(magic));
+	request.op = header[4];
+	request.kind = header[5];
+	request.cipher = header[6];
+	return magic == DAEMON_MAGIC
+		&& get_string(fd, request.kname) && get_string(fd, request.ifname) && get_string(fd, request.ofname)
+		&& get_bytes(fd, request.data, MAX_INLINE_BYTES);
+}
+
+static bool write_response(int fd, const Daemon_Response& response)
+{
+	Message_Writer writer;
+	writer.put(DAEMON_MAGIC);
+	writer.put((int32_t)response.status);
+	writer.put((int64_t)response.bytes);
+	writer.put_string(response.message);
+	writer.put_bytes(response.data.data(), response.data.size());
+	return send_all(fd, writer.bytes.data(), writer.bytes.size());
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+int DES_Daemon::listen(const std::string& socket_path)
+{
+	sockaddr_un addr{};
+	if (socket_path.size() >= sizeof(addr.sun_path))
+	{
+		return -1;
+	}
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path.c_str());
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+	{
+		return -1;
+	}
+	// socket file of previous daemon
+	unlink(socket_path.c_str());
+	// daemon reads and writes any path it can, so only its user may connect:
+	// mode of socket file is set before bind(where system takes it from descriptor) and after it, peers are checked in serve
+	fchmod(listen_fd, S_IRUSR | S_IWUSR);
+	if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) || chmod(socket_path.c_str(), S_IRUSR | S_IWUSR)
+		|| ::listen(listen_fd, 64))
+	{
+		close(listen_fd);
+		listen_fd = -1;
+		return -1;
+	}
+	path = socket_path;
+	return 0;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Only processes of the same user as daemon are served
+*/
+static bool peer_allowed(int fd)
+{
+#if defined(SO_PEERCRED)
+	ucred cred{};
+	socklen_t size = sizeof(cred);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) == 0 && cred.uid == geteuid();
+#else
+	uid_t uid;
+	gid_t gid;
+	return getpeereid(fd, &uid, &gid) == 0 && uid == geteuid();
+#endif
+}
+
+void DES_Daemon::serve()
+{
+	while (!stopping && listen_fd >= 0)
+	{
+		// wakes up sometimes to check stop()
+		pollfd pfd{ listen_fd, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) <= 0)
+		{
+			continue;
+		}
+		int fd = accept(listen_fd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			continue;
+		}
+		if (!peer_allowed(fd))
+		{
+			close(fd);
+			continue;
+		}
+		timeval timeout{ client_timeout_seconds, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		Daemon_Request request;
+		if (read_request(fd, request))
+		{
+			if (request.op == Daemon_Request::Shutdown)
+			{
+				stopping = true;
+				write_response(fd, Daemon_Response{});
+			}
+			else
+			{
+				write_response(fd, handle(request));
+			}
+		}
+		for (int passed : { request.in_fd, request.out_fd })
+		{
+			if (passed >= 0)
+			{
+				close(passed);
+			}
+		}
+		close(fd);
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+bool daemon_call(const std::string& socket_path, const Daemon_Request& request, Daemon_Response& response)
+{
+	sockaddr_un addr{};
+	if (socket_path.size() >= sizeof(addr.sun_path))
+	{
+		return false;
+	}
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+	if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+	{
+		close(fd);
+		return false;
+	}
+
+	Message_Writer writer;
+	writer.put(DAEMON_MAGIC);
+	writer.put((char)request.op);
+	writer.put((char)request.kind);
+	writer.put((char)request.cipher);
+	writer.put((char)0);
+	writer.put_string(request.kname);
+	writer.put_string(request.ifname);
+	writer.put_string(request.ofname);
+	writer.put_bytes(request.data.data(), request.data.size());
+
+	// header goes with descriptors, the rest - as plain stream
+	const size_t HEADER = 8;
+	iovec iov{ writer.bytes.data(), HEADER };
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	char control[CMSG_SPACE(2 * sizeof(int))] = {};
+	if (request.kind == Daemon_Request::Fds)
+	{
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+		int fds[2] = { request.in_fd, request.out_fd };
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	}
+	bool ok = sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)HEADER
+		&& send_all(fd, writer.bytes.data() + HEADER, writer.bytes.size() - HEADER);
+
+	uint32_t magic = 0;
+	int32_t status = 0;
+	int64_t bytes = 0;
+	ok = ok && get(fd, magic) && magic == DAEMON_MAGIC && get(fd, status) && get(fd, bytes)
+		&& get_string(fd, response.message) && get_bytes(fd, response.data, MAX_INLINE_BYTES + Buffer_Pool::ALIGNMENT);
+	response.status = status;
+	response.bytes = bytes;
+	close(fd);
+	return ok;
+}
+
+#else
+/*-------------------------------------------------------------------------------------------------------*/
+
+int DES_Daemon::listen(const std::string&)
+{
+	return -1;
+}
+
+void DES_Daemon::serve()
+{
+}
+
+bool daemon_call(const std::string&, const Daemon_Request&, Daemon_Response&)
+{
+	return false;
+}
+#endif
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void DES_Daemon::stop()
+{
+	stopping = true;
+}
+
+DES_Daemon::~DES_Daemon()
+{
+#ifndef _WIN32
+	if (listen_fd >= 0)
+	{
+		close(listen_fd);
+		unlink(path.c_str());
+	}
+#endif
+}
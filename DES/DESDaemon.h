@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "DESFileCrypt.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Request to daemon.
+op - File_Crypter::Encrypt or File_Crypter::Decrypt, Shutdown stops daemon.
+cipher - 0 - DES, 1 - EEE3, 2 - EDE3.
+Paths are opened by daemon, so they should be absolute.
+*/
+struct Daemon_Request
+{
+	enum Kinds { Paths, Buffer, Fds };
+	enum { Shutdown = 3 };
+	int op = File_Crypter::Encrypt;
+	int kind = Paths;
+	int cipher = 0;
+	std::string kname;
+	// Paths: input and output files
+	std::string ifname;
+	std::string ofname;
+	// Buffer: data to process, returned padded to blocks
+	std::vector<char> data;
+	// Fds: input and output descriptors of client, passed with SCM_RIGHTS
+	int in_fd = -1;
+	int out_fd = -1;
+};
+
+// status 0 - done, otherwise message tells what is wrong
+struct Daemon_Response
+{
+	int status = 0;
+	long long bytes = 0;
+	std::string message;
+	std::vector<char> data;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+LRU cache of crypters with read keys and expanded key schedules.
+Entry is found by path and hash of contents of key file(read on every request, so changed key file
+is never taken for the old one), cipher, mode and engine.
+*/
+class Key_Cache
+{
+public:
+	explicit Key_Cache(size_t capacity_ = 64);
+	// nullptr and error message if keys could not be read
+	std::shared_ptr<const File_Crypter> get(const std::string& kname, int cipher, int mode, int engine, std::string& error);
+	inline uint64_t hits() const { return _hits; }
+	inline uint64_t misses() const { return _misses; }
+	size_t size();
+private:
+	typedef std::pair<std::string, std::shared_ptr<const File_Crypter>> Entry;
+	size_t capacity;
+	std::mutex mtx;
+	std::list<Entry> lru;	// most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+	std::atomic<uint64_t> _hits{ 0 };
+	std::atomic<uint64_t> _misses{ 0 };
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Daemon serving requests over Unix domain socket with warm pool and key cache(POSIX only).
+Requests are served one at a time, every request is split over the whole pool.
+Socket file is accessible only to the user of daemon, connections of other users are dropped.
+*/
+class DES_Daemon
+{
+public:
+	DES_Daemon(ThreadPoolMy& pool_, size_t cache_capacity = 64);
+	DES_Daemon(const DES_Daemon&) = delete;
+	DES_Daemon& operator=(const DES_Daemon&) = delete;
+	// closes socket and removes its file
+	~DES_Daemon();
+	// 0 - listening, -1 - socket could not be created
+	int listen(const std::string& socket_path);
+	// accepts requests until stop() or Shutdown request
+	void serve();
+	void stop();
+	Daemon_Response handle(const Daemon_Request& request);
+
+	int engine = File_Crypter::Table;
+	int buffer_size = BUFSIZE;
+	// client that sends or takes nothing for so long is dropped, so it can't hang daemon
+	int client_timeout_seconds = 10;
+	Key_Cache cache;
+private:
+	ThreadPoolMy& pool;
+	int listen_fd = -1;
+	std::string path;
+	std::atomic<bool> stopping{ false };
+};
+
+// sends request to daemon and waits for response, false if daemon could not be reached
+bool daemon_call(const std::string& socket_path, const Daemon_Request& request, Daemon_Response& response);
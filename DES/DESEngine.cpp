@@ -0,0 +1,114 @@
+#include "stdafx.h"
+#include "DESEngine.h"
+
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Key_Schedule::Key_Schedule(uint64_t key, int mode_)
+	: keys(DESEncrypter{ 0, key, mode_ }.round_keys()), mode{ mode_ }
+{
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Lookup tables of table engine.
+Permutation is selection of bits, so result for whole block is OR of results for its bytes:
+byte_table[i][v] = transformation of block with byte i equal to v and other bytes zero.
+sp[i][v] - 6 bits group i of expanded half-block equal to v, after S-box i and permutation P.
+*/
+struct DES_Tables
+{
+	std::array<std::array<uint64_t, 256>, 8> initial;
+	std::array<std::array<uint64_t, 256>, 8> final;
+	std::array<std::array<uint64_t, 256>, 4> expanding;
+	std::array<std::array<uint32_t, 64>, 8> sp;
+
+	DES_Tables()
+	{
+		for (int byte = 0; byte < 8; ++byte)
+		{
+			for (uint64_t v = 0; v < 256; ++v)
+			{
+				initial[byte][v] = v << (8 * byte);
+				transformation(initial[byte][v], BLOCK_SIZE, initial_permutation_array);
+				final[byte][v] = v << (8 * byte);
+				transformation(final[byte][v], BLOCK_SIZE, final_permutation_array);
+				if (byte < 4)
+				{
+					expanding[byte][v] = v << (8 * byte);
+					transformation(expanding[byte][v], EXPANDED_HALF_BLOCK_SIZE, expanding_array);
+				}
+			}
+		}
+		for (int box = 0; box < 8; ++box)
+		{
+			for (int v = 0; v < 64; ++v)
+			{
+				// the same row and column as DESEncrypter::narrow_block
+				int row = ((v & (1 << 5)) >> 4) + (v & 1);
+				int col = (v & 0b011110) >> 1;
+				uint64_t res = (uint64_t)(*trans_table[box])[row][col] << (box * 4);
+				transformation(res, HALF_BLOCK_SIZE, f_final_permutation_array);
+				sp[box][v] = (uint32_t)res;
+			}
+		}
+	}
+};
+
+static const DES_Tables& tables()
+{
+	static const DES_Tables t;
+	return t;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static inline uint64_t permute64(uint64_t block, const std::array<std::array<uint64_t, 256>, 8>& table)
+{
+	return table[0][block & 0xff] | table[1][(block >> 8) & 0xff] | table[2][(block >> 16) & 0xff] | table[3][(block >> 24) & 0xff]
+		| table[4][(block >> 32) & 0xff] | table[5][(block >> 40) & 0xff] | table[6][(block >> 48) & 0xff] | table[7][block >> 56];
+}
+
+static inline uint32_t feistel(uint32_t half, uint64_t key, const DES_Tables& t)
+{
+	uint64_t expanded = t.expanding[0][half & 0xff] | t.expanding[1][(half >> 8) & 0xff]
+		| t.expanding[2][(half >> 16) & 0xff] | t.expanding[3][half >> 24];
+	expanded ^= key;
+	return t.sp[0][expanded & 0x3f] | t.sp[1][(expanded >> 6) & 0x3f] | t.sp[2][(expanded >> 12) & 0x3f]
+		| t.sp[3][(expanded >> 18) & 0x3f] | t.sp[4][(expanded >> 24) & 0x3f] | t.sp[5][(expanded >> 30) & 0x3f]
+		| t.sp[6][(expanded >> 36) & 0x3f] | t.sp[7][(expanded >> 42) & 0x3f];
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Same rounds as DESEncrypter::run, including its decrypt variant
+*/
+uint64_t table_des_block(uint64_t block, const Key_Schedule& schedule)
+{
+	const DES_Tables& t = tables();
+	block = permute64(block, t.initial);
+	uint32_t Li = (uint32_t)(block >> 32);
+	uint32_t Ri = (uint32_t)block;
+	if (schedule.mode == DESEncrypter::ENCRYPT)
+	{
+		for (int i = 0; i < ROUNDS; ++i)
+		{
+			uint32_t ltemp = Li;
+			Li = Ri;
+			Ri = ltemp ^ feistel(Ri, schedule.keys[i], t);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < ROUNDS; ++i)
+		{
+			uint32_t ltemp = Li;
+			Li = Ri ^ feistel(Li, schedule.keys[i], t);
+			Ri = ltemp;
+		}
+	}
+	block = ((uint64_t)Li << 32) + Ri;
+	return permute64(block, t.final);
+}
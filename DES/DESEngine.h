@@ -0,0 +1,25 @@
+#pragma once
+#include "DES.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Round keys of one key in order they are used by DESEncrypter with the same mode.
+	Computed once per key, so engines don't repeat key schedule for every block.
+*/
+struct Key_Schedule
+{
+	Key_Schedule(uint64_t key, int mode_);
+
+	std::array<uint64_t, ROUNDS> keys;
+	int mode;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Table-driven engine, bit for bit the same as DESEncrypter::run.
+	Permutations and expansion are done by byte lookup tables, S-boxes are merged with permutation P.
+	Tables are built from arrays of DES.h by transformation() itself, so conventions can't diverge.
+*/
+uint64_t table_des_block(uint64_t block, const Key_Schedule& schedule);
@@ -1,6 +1,57 @@
 #include "stdafx.h"
 #include "DESFileCrypt.h"
+#include "DESTrace.h"
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
 
+namespace fs = std::filesystem;
+
+
+typedef std::chrono::steady_clock stage_clock;
+
+/*
+Input and output go through these two, so it is one region for performance counters.
+read_chunk returns number of bytes read, less than size only at the end of input.
+*/
+int read_chunk(Byte_Reader& in, char* buffer, int size)
+{
+	DES_PERF_SCOPE(PERF_FILE_IO);
+	DES_TRACE_SPAN("read");
+	return in.read(buffer, size);
+}
+
+void write_chunk(Byte_Writer& out, const char* buffer, int size)
+{
+	DES_PERF_SCOPE(PERF_FILE_IO);
+	DES_TRACE_SPAN("write");
+	out.write(buffer, size);
+}
+
+/*
+Returns seconds passed since start and moves start to now,
+so consecutive stages can be timed with one variable.
+*/
+static double lap(stage_clock::time_point& start)
+{
+	stage_clock::time_point now = stage_clock::now();
+	double seconds = std::chrono::duration<double>(now - start).count();
+	start = now;
+	return seconds;
+}
+
+/*
+Alignning data to 64 bits: pads last block of 'bytes' bytes in buffer with zeros.
+Returns padded size.
+*/
+int pad_to_blocks(char* buffer, int bytes)
+{
+	int to_align = (BLOCKSIZE - bytes % BLOCKSIZE) == BLOCKSIZE ? 0 : (BLOCKSIZE - bytes % BLOCKSIZE);
+	memset(buffer + bytes, 0, to_align);
+	return bytes + to_align;
+}
 
 /*
 Used both in signlethread and multithread versions.
@@ -8,7 +59,11 @@ Processes 'blocks' blocks in one function. Blocks size assumed to be sizeof(uint
 */
 void File_Crypter::run_des(char* buffer, int blocks)
 {
-
+	if (engine == Table)
+	{
+		run_des_table(buffer, blocks);
+		return;
+	}
 	thread_local uint64_t res = 0;
 	if (!triple_des)	//DES
 	{
@@ -64,6 +119,95 @@ uint64_t File_Crypter::encrypt_tiple_des(char* buffer)
 	return res;
 }
 
+/*
+Key schedules for the same stages(keys and directions) as DES, encrypt_tiple_des and decrypt_tiple_des use
+*/
+std::vector<Key_Schedule> File_Crypter::key_schedules() const
+{
+	std::vector<Key_Schedule> stages;
+	if (!triple_des)
+	{
+		stages.emplace_back(keys[0], mode);
+	}
+	else
+	{
+		for (int key = 0; key < 3; ++key)
+		{
+			if (mode == Modes::Encrypt)
+			{
+				stages.emplace_back(keys[key], triple_des_mode == EEE3 ? mode : key % 2);
+			}
+			else if (mode == Modes::Decrypt)
+			{
+				stages.emplace_back(keys[2 - key], triple_des_mode == EEE3 ? mode : 1 - (key % 2));
+			}
+		}
+	}
+	return stages;
+}
+
+/*
+Keys and modes key schedules depend on, unused keys are left zero
+*/
+File_Crypter::Schedule_Setting File_Crypter::schedule_setting() const
+{
+	Schedule_Setting setting{};
+	for (int i = 0; i < keys_number; ++i)
+	{
+		setting.keys[i] = keys[i];
+	}
+	setting.keys_number = keys_number;
+	setting.mode = mode;
+	setting.triple_des = triple_des;
+	setting.triple_des_mode = triple_des ? triple_des_mode : 0;
+	return setting;
+}
+
+void File_Crypter::prepare_schedules()
+{
+	if (engine != Table || schedules)
+	{
+		return;
+	}
+	Schedule_Setting setting = schedule_setting();
+	if (!prepared_schedules || !(prepared_setting == setting))
+	{
+		prepared_schedules = std::make_shared<const std::vector<Key_Schedule>>(key_schedules());
+		prepared_setting = setting;
+	}
+}
+
+/*
+run_des with table engine.
+Key schedules are taken from schedules if set, then from prepare_schedules if they match current setting,
+else computed for this call.
+*/
+void File_Crypter::run_des_table(char* buffer, int blocks)
+{
+	std::vector<Key_Schedule> computed;
+	const std::vector<Key_Schedule>* stages_ptr = schedules.get();
+	if (!stages_ptr && prepared_schedules && prepared_setting == schedule_setting())
+	{
+		stages_ptr = prepared_schedules.get();
+	}
+	if (!stages_ptr)
+	{
+		computed = key_schedules();
+		stages_ptr = &computed;
+	}
+	const std::vector<Key_Schedule>& stages = *stages_ptr;
+	for (int block = 0; block < blocks; ++block)
+	{
+		uint64_t res;
+		memcpy(&res, buffer + sizeof(uint64_t) * block, BLOCKSIZE);
+		for (const Key_Schedule& stage : stages)
+		{
+			res = table_des_block(res, stage);
+		}
+		memcpy(buffer + sizeof(uint64_t) * block, &res, BLOCKSIZE);
+	}
+}
+
 uint64_t File_Crypter::decrypt_tiple_des(char* buffer)
 {
 	uint64_t res = *reinterpret_cast<uint64_t*>(buffer);
@@ -87,43 +231,227 @@ uint64_t File_Crypter::decrypt_tiple_des(char* buffer)
 	return res;
 }
 
+/*
+Input and output are reader and writer if set, otherwise ifname and ofname opened with io backend("-" is stdin/stdout).
+With checkpoint run of files resumes where the interrupted one stopped.
+With range only that range of input is processed into shard file or the same range of shared output.
+Returns -1 if input or output could not be opened or failed.
+*/
 int File_Crypter::run()
 {
-	if (multithread)
+	stats = Run_Stats{};
+	input_checksum = Stream_Checksum(checksum);
+	output_checksum = Stream_Checksum(checksum);
+	resumed_bytes = 0;
+	prepare_schedules();
+	checkpointing = !checkpoint.empty() && !ranged() && !reader && !writer && ifname != "-" && ofname != "-";
+	if (checkpointing)
 	{
-		return run_mt();
+		start_checkpoint();
 	}
-	// opening files
-	std::ifstream ifs;
-	ifs.open(ifname, std::ios_base::binary);
-	std::ofstream ofs;
-	ofs.open(ofname, std::ios_base::binary);
-	if (!ifs || !ofs)
+	// opening files, resumed output is written from where it stopped
+	std::unique_ptr<Byte_Reader> own_reader;
+	std::unique_ptr<Byte_Writer> own_writer;
+	if (!reader)
+	{
+		own_reader = open_reader(ifname, io);
+	}
+	if (!writer)
+	{
+		if (resumed_bytes)
+		{
+			own_writer = open_writer_at(ofname, progress.output_offset, io);
+		}
+		else
+		{
+			own_writer = ranged() && shared_output ? open_writer_at(ofname, range_start, io) : open_writer(ofname, io);
+		}
+	}
+	Byte_Reader* in = reader ? reader : own_reader.get();
+	Byte_Writer* out = writer ? writer : own_writer.get();
+	if (!in || !out || (resumed_bytes && !in->seek(progress.input_offset)))
+	{
+		return -1;
+	}
+	// range of input is read through Range_Reader
+	std::unique_ptr<Range_Reader> range_reader;
+	Shard_Header shard;
+	if (ranged())
+	{
+		shard.input_bytes = in->size();
+		shard.start = range_start;
+		shard.end = range_end < 0 ? shard.input_bytes : std::min(range_end, shard.input_bytes);
+		if (shard.input_bytes < 0 || range_start % BLOCKSIZE || range_start > shard.end
+			|| (shard.end % BLOCKSIZE && shard.end != shard.input_bytes) || !in->seek(range_start))
+		{
+			return -1;
+		}
+		range_reader.reset(new Range_Reader(*in, shard.end - shard.start));
+		in = range_reader.get();
+	}
+	try
+	{
+		if (ranged() && !shared_output)
+		{
+			write_shard_header(*out, shard);
+		}
+		// small files are faster to process in one thread, input of unknown size(pipe) may be big
+		int result;
+		if (multithread && (!adaptive || in->size() < 0 || parallel_portions(in->size() - resumed_bytes, 2) > 1))
+		{
+			result = run_mt(*in, *out);
+		}
+		else
+		{
+			result = run_st(*in, *out);
+		}
+		if (checkpointing)
+		{
+			own_writer.reset();
+			std::error_code ec;
+			// output of interrupted run may have partly written chunk after the end
+			fs::resize_file(ofname, progress.output_offset, ec);
+			std::remove(checkpoint.c_str());
+		}
+		// the last range of shared output cuts what is left after the end of output
+		if (ranged() && shared_output && !writer && shard.end == shard.input_bytes)
+		{
+			own_writer.reset();
+			std::error_code ec;
+			fs::resize_file(ofname, shard.start + (shard.end - shard.start + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE, ec);
+		}
+		return result;
+	}
+	catch (const std::runtime_error&)
 	{
 		return -1;
 	}
-	char* buffer = new char[BUFSIZE];
-	ifs.read(buffer, BUFSIZE);
-	uint64_t res;
-	int done = 0;
-	while (ifs.gcount() != 0)
+}
+
+int File_Crypter::run_st(Byte_Reader& in, Byte_Writer& out)
+{
+	const int chunk = chunk_size();
+	Pooled_Buffer pooled(chunk);
+	char* buffer = pooled.get();
+	std::vector<Leaf_Sums> sums(checksum ? chunk / CHECKSUM_LEAF : 0);
+	stage_clock::time_point lap_start = stage_clock::now();
+	int got = read_chunk(in, buffer, chunk);
+	stats.read_seconds += lap(lap_start);
+	while (got != 0)
 	{
-		// alignning data to 64 bits
-		int to_align = (BLOCKSIZE - ifs.gcount() % BLOCKSIZE) == BLOCKSIZE ? 0 : (BLOCKSIZE - ifs.gcount() % BLOCKSIZE);
-		int to_read = ifs.gcount() + to_align;
-		memset(buffer + ifs.gcount(), 0, to_align);
+		stats.bytes += got;
+		int to_read = pad_to_blocks(buffer, got);
 		// processing blocks
-		for (int i = 0; i < to_read; i += BLOCKSIZE)
 		{
-			run_des(buffer + i, 1);
+			DES_TRACE_SPAN("run_des");
+			process_leaves(buffer, 0, to_read, got, checksum ? sums.data() : nullptr);
 		}
-		ofs.write(buffer, to_read);
-		ifs.read(buffer, BUFSIZE);
+		fold_checksums(sums.data(), got, to_read);
+		stats.compute_seconds += lap(lap_start);
+		write_chunk(out, buffer, to_read);
+		chunk_written(out, buffer, to_read, got);
+		stats.write_seconds += lap(lap_start);
+		got = read_chunk(in, buffer, chunk);
+		stats.read_seconds += lap(lap_start);
 	}
-	delete[] buffer;
 	return 0;
 }
 
+/*
+Progress of resumable run: the saved one if it is made for this input and setting and written tail of output is intact,
+otherwise the new one from the beginning
+*/
+void File_Crypter::start_checkpoint()
+{
+	Checkpoint fresh;
+	fresh.mode = mode;
+	fresh.cipher = cipher();
+	fresh.key_check = key_check();
+	std::error_code ec;
+	fresh.input_bytes = (long long)fs::file_size(ifname, ec);
+	fresh.input_time = fs::last_write_time(ifname, ec).time_since_epoch().count();
+	progress = fresh;
+	Checkpoint saved;
+	if (!load_checkpoint(checkpoint, saved) || saved.mode != fresh.mode || saved.cipher != fresh.cipher
+		|| saved.key_check != fresh.key_check || saved.input_bytes != fresh.input_bytes || saved.input_time != fresh.input_time
+		|| saved.input_offset % BLOCKSIZE || saved.input_offset > saved.input_bytes || !tail_intact(saved))
+	{
+		return;
+	}
+	progress = saved;
+	resumed_bytes = saved.input_offset;
+}
+
+/*
+Written chunks of saved checkpoint are read back from output, they could be lost if system went down
+*/
+bool File_Crypter::tail_intact(const Checkpoint& saved) const
+{
+	std::error_code ec;
+	if ((long long)fs::file_size(ofname, ec) < saved.output_offset || ec)
+	{
+		return false;
+	}
+	std::ifstream ifs(ofname, std::ios_base::binary);
+	std::vector<char> buffer;
+	for (const Checked_Range& range : saved.tail)
+	{
+		buffer.resize(range.size);
+		ifs.seekg(range.offset, std::ios_base::beg);
+		if (!ifs.read(buffer.data(), range.size) || xxh64(buffer.data(), range.size, 0) != range.hash)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+Counts chunk written in order of file into progress of resumable run and saves it every checkpoint_interval chunks.
+Output is flushed first, so checkpoint never gets ahead of data.
+*/
+void File_Crypter::chunk_written(Byte_Writer& out, const char* buffer, int size, int data_bytes)
+{
+	if (!checkpointing)
+	{
+		return;
+	}
+	progress.tail.push_back(Checked_Range{ progress.output_offset, size, xxh64(buffer, size, 0) });
+	if (progress.tail.size() > CHECKPOINT_TAIL)
+	{
+		progress.tail.erase(progress.tail.begin());
+	}
+	++progress.done_chunks;
+	progress.input_offset += data_bytes;
+	progress.output_offset += size;
+	if (progress.done_chunks % std::max(1, checkpoint_interval) == 0)
+	{
+		out.flush();
+		// run goes on without checkpoint if it can't be saved, it is only lost progress
+		save_checkpoint(checkpoint, progress);
+	}
+}
+
+uint32_t File_Crypter::key_check()
+{
+	uint64_t block = 0;
+	run_des(reinterpret_cast<char*>(&block), 1);
+	return (uint32_t)(block & 0xFFFFFF);
+}
+
+/*
+Size of chunk that is processed at once: buffer_size rounded down to BLOCKSIZE(to CHECKSUM_LEAF with checksums)
+*/
+int File_Crypter::chunk_size() const
+{
+	// with checksums chunks are whole leaves, so leaves are the same for any buffer size
+	if (checksum)
+	{
+		return std::max(CHECKSUM_LEAF, buffer_size - buffer_size % CHECKSUM_LEAF);
+	}
+	return std::max(BLOCKSIZE, buffer_size - buffer_size % BLOCKSIZE);
+}
+
 
 /*
 writing generated keys into keyfile
@@ -152,10 +480,15 @@ int File_Crypter::read_keys()
 	{
 		return -1;
 	}
+	return read_keys(ifs);
+}
+
+int File_Crypter::read_keys(std::istream& is)
+{
 	int n = 0;
-	while (ifs && (n != 3))	//3 keys max
+	while (is && (n != 3))	//3 keys max
 	{
-		ifs.read(reinterpret_cast<char*>(&keys[n]), sizeof(uint64_t));
+		is.read(reinterpret_cast<char*>(&keys[n]), sizeof(uint64_t));
 		n++;
 	}
 	keys_number = n;
@@ -207,45 +540,307 @@ int File_Crypter::set_triple_des_mode(int tdmode)
 /*----------------------------MULTITHREAD----------------------------*/
 
 /*
-Multithread version of run
+Multithread version of run.
+Two chunk buffers are used, so I/O overlaps with processing: while executor processes one chunk,
+calling thread writes the previous one and reads the next one into its buffer.
 */
-int File_Crypter::run_mt()
+int File_Crypter::run_mt(Byte_Reader& in, Byte_Writer& out)
 {
-	// opening files
-	int done = 0;
-	std::ifstream ifs;
-	ifs.open(ifname, std::ios_base::binary);
-	std::ofstream ofs;
-	ofs.open(ofname, std::ios_base::binary);
-	if (!ifs || !ofs)
+	if (!executor && node_pools && node_pools->nodes() > 1)
 	{
-		return -1;
+		return run_mt_numa(in, out);
 	}
-	ThreadPoolMy thread_pool;
-	char* buffer = new char[BUFSIZE];
-	ifs.read(buffer, BUFSIZE);
-	uint64_t res;
-	while (ifs.gcount() != 0)
+	std::optional<Pool_Executor> pool_executor;
+	if (!executor)
 	{
-		// alignning data to 64 bits
-		int to_align = (BLOCKSIZE - ifs.gcount() % BLOCKSIZE) == BLOCKSIZE ? 0 : (BLOCKSIZE - ifs.gcount() % BLOCKSIZE);
-		int to_read = ifs.gcount() + to_align;
-		memset(buffer + ifs.gcount(), 0, to_align);
-		// processing blocks
-		int offset = 0;
-		for (int i = 0; i < thread_pool.size() - 1; ++i)
+		pool_executor.emplace(compute_pool());
+	}
+	Executor& ex = executor ? *executor : *pool_executor;
+	const int chunk = chunk_size();
+	Pooled_Buffer buffers[2] = { Pooled_Buffer(chunk), Pooled_Buffer(chunk) };
+	task_group chunk_tasks[2];
+	int sizes[2] = { 0, 0 };
+	// input bytes of chunks(without padding) and checksums of their leaves
+	int data_sizes[2] = { 0, 0 };
+	std::vector<Leaf_Sums> sums[2];
+	for (std::vector<Leaf_Sums>& chunk_sums : sums)
+	{
+		chunk_sums.resize(checksum ? chunk / CHECKSUM_LEAF : 0);
+	}
+	int cur = 0;
+	// chunk of the other buffer is processed and waits to be written
+	bool pending = false;
+	try
+	{
+		stage_clock::time_point lap_start = stage_clock::now();
+		int got = read_chunk(in, buffers[cur].get(), chunk);
+		stats.read_seconds += lap(lap_start);
+		while (got != 0)
+		{
+			stats.bytes += got;
+			data_sizes[cur] = got;
+			sizes[cur] = pad_to_blocks(buffers[cur].get(), got);
+			// calling thread is busy with I/O, it joins in wait
+			int portions = adaptive ? parallel_portions(sizes[cur], ex.concurrency()) : ex.concurrency();
+			start_portions(ex, chunk_tasks[cur], buffers[cur].get(), sizes[cur], portions, got, checksum ? sums[cur].data() : nullptr);
+			int other = 1 - cur;
+			if (pending)
+			{
+				write_chunk(out, buffers[other].get(), sizes[other]);
+				chunk_written(out, buffers[other].get(), sizes[other], data_sizes[other]);
+				stats.write_seconds += lap(lap_start);
+			}
+			got = read_chunk(in, buffers[other].get(), chunk);
+			stats.read_seconds += lap(lap_start);
+			// helping workers with the rest
+			{
+				DES_TRACE_SPAN("wait");
+				ex.wait(chunk_tasks[cur]);
+			}
+			fold_checksums(sums[cur].data(), data_sizes[cur], sizes[cur]);
+			stats.compute_seconds += lap(lap_start);
+			pending = true;
+			cur = other;
+		}
+		if (pending)
 		{
-			thread_pool.wait_do_task(std::bind(&File_Crypter::run_des, this, buffer + offset, to_read / BLOCKSIZE / thread_pool.size()));
-			offset += to_read / thread_pool.size();
+			write_chunk(out, buffers[1 - cur].get(), sizes[1 - cur]);
+			chunk_written(out, buffers[1 - cur].get(), sizes[1 - cur], data_sizes[1 - cur]);
+			stats.write_seconds += lap(lap_start);
 		}
-		// processing last portion of blocks
-		thread_pool.wait_do_task(std::bind(&File_Crypter::run_des, this, buffer + offset, (to_read - offset) / BLOCKSIZE));
-		thread_pool.wait_all_tasks();
-		ofs.write(buffer, to_read);
-		ifs.read(buffer, BUFSIZE);
 	}
-	// waiting before deleting buffer
-	thread_pool.wait_all_tasks();
-	delete[] buffer;
+	catch (...)
+	{
+		// workers must not touch buffers after they are released
+		ex.wait(chunk_tasks[0]);
+		ex.wait(chunk_tasks[1]);
+		throw;
+	}
 	return 0;
-}
\ No newline at end of file
+}
+
+/*
+Processes 'bytes' bytes(whole blocks) of buffer in memory.
+In multithread mode buffer is split into portions of executor like chunk of run_mt.
+*/
+void File_Crypter::run_buffer(char* buffer, int bytes)
+{
+	prepare_schedules();
+	std::optional<Pool_Executor> pool_executor;
+	if (multithread && !executor)
+	{
+		pool_executor.emplace(compute_pool());
+	}
+	Executor* ex = !multithread ? nullptr : (executor ? executor : &*pool_executor);
+	int portions = !ex ? 1 : (adaptive ? parallel_portions(bytes, ex->concurrency()) : ex->concurrency());
+	if (portions == 1)
+	{
+		run_des(buffer, bytes / BLOCKSIZE);
+		return;
+	}
+	task_group tasks;
+	start_portions(*ex, tasks, buffer, bytes, portions, bytes, nullptr);
+	ex->wait(tasks);
+}
+
+/*
+Multithread version for NUMA machines(node_pools with more than one node).
+Every node has its own chunk buffer, taken from Buffer_Pool of the node(fresh pages, reused only by the same node)
+and first touched by workers of that node, so its pages live there.
+Chunks are read into buffers of nodes in turn and processed by the pool of the same node,
+then written in the same order.
+*/
+int File_Crypter::run_mt_numa(Byte_Reader& in, Byte_Writer& out)
+{
+	int nodes = node_pools->nodes();
+	const int chunk = chunk_size();
+	std::vector<Pooled_Buffer> buffers(nodes);
+	for (int node = 0; node < nodes; ++node)
+	{
+		Pooled_Buffer& buffer = buffers[node];
+		Buffer_Pool& buffer_pool = node_pools->buffer_pool(node);
+		node_pools->pool(node).wait_do_task([&buffer, &buffer_pool, chunk]()
+		{
+			buffer = Pooled_Buffer(chunk, buffer_pool);
+			memset(buffer.get(), 0, chunk);
+		}).get();
+	}
+	std::unique_ptr<task_group[]> chunk_tasks(new task_group[nodes]);
+	std::vector<int> sizes(nodes);
+	std::vector<int> data_sizes(nodes);
+	std::vector<std::vector<Leaf_Sums>> sums(nodes, std::vector<Leaf_Sums>(checksum ? chunk / CHECKSUM_LEAF : 0));
+	bool eof = false;
+	stage_clock::time_point lap_start = stage_clock::now();
+	try
+	{
+		while (!eof)
+		{
+			int filled = 0;
+			for (; filled < nodes; ++filled)
+			{
+				int got = read_chunk(in, buffers[filled].get(), chunk);
+				stats.read_seconds += lap(lap_start);
+				if (got == 0)
+				{
+					eof = true;
+					break;
+				}
+				stats.bytes += got;
+				data_sizes[filled] = got;
+				sizes[filled] = pad_to_blocks(buffers[filled].get(), got);
+				ThreadPoolMy& pool = node_pools->pool(filled);
+				int portions = adaptive ? parallel_portions(sizes[filled], pool.size()) : pool.size();
+				Pool_Executor ex(pool);
+				start_portions(ex, chunk_tasks[filled], buffers[filled].get(), sizes[filled], portions, got, checksum ? sums[filled].data() : nullptr);
+				stats.compute_seconds += lap(lap_start);
+			}
+			for (int node = 0; node < filled; ++node)
+			{
+				{
+					DES_TRACE_SPAN("wait");
+					node_pools->pool(node).wait_group(chunk_tasks[node]);
+				}
+				fold_checksums(sums[node].data(), data_sizes[node], sizes[node]);
+				stats.compute_seconds += lap(lap_start);
+				write_chunk(out, buffers[node].get(), sizes[node]);
+				chunk_written(out, buffers[node].get(), sizes[node], data_sizes[node]);
+				stats.write_seconds += lap(lap_start);
+			}
+		}
+	}
+	catch (...)
+	{
+		for (int node = 0; node < nodes; ++node)
+		{
+			node_pools->pool(node).wait_group(chunk_tasks[node]);
+		}
+		throw;
+	}
+	return 0;
+}
+
+/*
+Number of portions(from 1 to max_portions) that is worth to split 'bytes' bytes into,
+so every portion takes at least MIN_TASK_NS by measured cost of block.
+*/
+int File_Crypter::parallel_portions(long long bytes, int max_portions) const
+{
+	double work_ns = (double)(bytes / BLOCKSIZE) * block_cost_ns();
+	long long portions = (long long)(work_ns / MIN_TASK_NS);
+	return (int)std::max(1LL, std::min((long long)max_portions, portions));
+}
+
+/*
+Cost of one block(in nanoseconds) for current DES/Triple-DES setting and engine.
+Measured once per process.
+*/
+double File_Crypter::block_cost_ns() const
+{
+	if (engine == Table)
+	{
+		static const double des_cost = measure_block_cost_ns(false, Table);
+		static const double triple_des_cost = measure_block_cost_ns(true, Table);
+		return triple_des ? triple_des_cost : des_cost;
+	}
+	static const double des_cost = measure_block_cost_ns(false, Reference);
+	static const double triple_des_cost = measure_block_cost_ns(true, Reference);
+	return triple_des ? triple_des_cost : des_cost;
+}
+
+double File_Crypter::measure_block_cost_ns(bool triple, int engine)
+{
+	const int blocks = 256;
+	File_Crypter fc;
+	fc.engine = engine;
+	fc.mode = Encrypt;
+	fc.triple_des = triple;
+	fc.set_triple_des_mode(EEE3);
+	fc.set_3keys(generate_random64(), generate_random64(), generate_random64());
+	// as in run, schedules are expanded once
+	fc.prepare_schedules();
+	std::vector<uint64_t> buffer(blocks, 0);
+	double best = 0;
+	// best of several runs, so random preemption doesn't spoil measurement
+	for (int i = 0; i < 3; ++i)
+	{
+		auto before = std::chrono::steady_clock::now();
+		fc.run_des(reinterpret_cast<char*>(buffer.data()), blocks);
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - before).count();
+		if (i == 0 || ns < best)
+		{
+			best = ns;
+		}
+	}
+	return best / blocks;
+}
+
+/*
+Pool of multithread mode without executor: pool of the first node, thread_pool or process-wide pool
+*/
+ThreadPoolMy& File_Crypter::compute_pool() const
+{
+	return node_pools ? node_pools->pool(0) : (thread_pool ? *thread_pool : ThreadPoolMy::shared());
+}
+
+/*
+Starts processing of 'bytes' bytes(whole blocks) of chunk buffer as 'portions' tasks of executor in group,
+the last portion takes the rest of blocks.
+With checksums(sums is set) portions are made of whole leaves, data_bytes - input bytes of chunk without padding.
+*/
+void File_Crypter::start_portions(Executor& ex, task_group& group, char* buffer, int bytes, int portions, int data_bytes, Leaf_Sums* sums)
+{
+	int total_blocks = bytes / BLOCKSIZE;
+	int portion_blocks = total_blocks / portions;
+	if (sums)
+	{
+		const int leaf_blocks = CHECKSUM_LEAF / BLOCKSIZE;
+		portion_blocks = (std::max(portion_blocks, 1) + leaf_blocks - 1) / leaf_blocks * leaf_blocks;
+		portions = (total_blocks + portion_blocks - 1) / portion_blocks;
+	}
+	ex.start(portions, [this, buffer, bytes, portions, portion_blocks, data_bytes, sums](int i)
+	{
+		int offset = i * portion_blocks * BLOCKSIZE;
+		int blocks = (i == portions - 1) ? (bytes - offset) / BLOCKSIZE : portion_blocks;
+		DES_TRACE_SPAN("run_des");
+		process_leaves(buffer, offset, blocks * BLOCKSIZE, data_bytes, sums);
+	}, group);
+}
+
+/*
+Processes 'bytes' bytes of chunk buffer from offset.
+With checksums it goes leaf by leaf: input of leaf is checksummed before processing and output after it,
+while leaf is in cache. Values go to sums by index of leaf in chunk.
+*/
+void File_Crypter::process_leaves(char* buffer, int offset, int bytes, int data_bytes, Leaf_Sums* sums)
+{
+	if (!sums)
+	{
+		run_des(buffer + offset, bytes / BLOCKSIZE);
+		return;
+	}
+	for (int leaf = offset; leaf < offset + bytes; leaf += CHECKSUM_LEAF)
+	{
+		int size = std::min(CHECKSUM_LEAF, offset + bytes - leaf);
+		Leaf_Sums& leaf_sums = sums[leaf / CHECKSUM_LEAF];
+		leaf_sums.input = input_checksum.leaf(buffer + leaf, std::max(0, std::min(size, data_bytes - leaf)));
+		run_des(buffer + leaf, size / BLOCKSIZE);
+		leaf_sums.output = output_checksum.leaf(buffer + leaf, size);
+	}
+}
+
+/*
+Folds checksums of leaves of processed chunk into checksums of run, chunks must come in order
+*/
+void File_Crypter::fold_checksums(const Leaf_Sums* sums, int data_bytes, int bytes)
+{
+	if (!checksum)
+	{
+		return;
+	}
+	for (int leaf = 0; leaf < bytes; leaf += CHECKSUM_LEAF)
+	{
+		int size = std::min(CHECKSUM_LEAF, bytes - leaf);
+		input_checksum.add(sums[leaf / CHECKSUM_LEAF].input, std::max(0, std::min(size, data_bytes - leaf)));
+		output_checksum.add(sums[leaf / CHECKSUM_LEAF].output, size);
+	}
+}
@@ -1,16 +1,49 @@
 #pragma once
 #include <fstream>
-#include "des.h"
+#include <memory>
+#include <vector>
+#include "DES.h"
+#include "DESBufferPool.h"
+#include "DESCheckpoint.h"
+#include "DESChecksum.h"
+#include "DESEngine.h"
+#include "DESShard.h"
+#include "DESStream.h"
 #include "DESTechTools.h"
+#include "Multithread/Executor.h"
 #include "Multithread/ThreadPoolMy.h"
 
 const int BUFSIZE = 1024 * 1024;
 const int BLOCKSIZE = 8;
+// minimal work for one task of multithread mode, smaller tasks cost more to schedule than to do
+const int MIN_TASK_NS = 50000;
+
+/*
+Statistics of File_Crypter::run: input bytes and time of stages in seconds.
+In multithread mode compute time is time calling thread spent on processing of chunk
+(its own portion and waiting for workers).
+*/
+struct Run_Stats
+{
+	long long bytes = 0;
+	double read_seconds = 0;
+	double compute_seconds = 0;
+	double write_seconds = 0;
+};
+
+/*
+Chunk helpers of File_Crypter, also used by Batch_Crypter.
+read_chunk and write_chunk are the perf/trace regions of I/O, read_chunk returns bytes read,
+pad_to_blocks pads last block of 'bytes' bytes in buffer with zeros and returns padded size.
+*/
+int read_chunk(Byte_Reader& in, char* buffer, int size);
+void write_chunk(Byte_Writer& out, const char* buffer, int size);
+int pad_to_blocks(char* buffer, int bytes);
 
 /*
 File crypt helper.
 ifname - input file name,
-ofname - output file name,
+ofname - output file name("-" - stdin/stdout),
 kname - key file name
 */
 class File_Crypter
@@ -18,30 +51,120 @@ class File_Crypter
 public:
 	enum Modes { Decrypt, Encrypt, Gen_Keys };
 	enum Triple_DES_Modes { EEE3, EDE3 };
+	// Reference - DESEncrypter, Table - table_des_block(same output, faster)
+	enum Engines { Reference, Table };
 	int mode;
 	std::string ifname;
 	std::string ofname;
 	std::string kname;
 	bool triple_des = false;
 	bool multithread = false;
+	int engine = Reference;
+	// in multithread mode choose fan-out width(and whether to use threads at all)
+	// from the input size and measured cost of block
+	bool adaptive = true;
+	// size of chunk read from file at once, rounded down to BLOCKSIZE
+	int buffer_size = BUFSIZE;
+	// backend of opened files, Io_Backends
+	int io = IO_STREAM;
+	// used instead of ifname and ofname if set(for example, descriptors passed to daemon), not owned
+	Byte_Reader* reader = nullptr;
+	Byte_Writer* writer = nullptr;
+	// statistics of the last run
+	Run_Stats stats;
+	// checksums of input(without padding) and output computed in the same pass as processing, Checksum_Kinds
+	int checksum = NO_CHECKSUM;
+	// checksums of the last run
+	Stream_Checksum input_checksum;
+	Stream_Checksum output_checksum;
+	// checkpoint file of resumable run: progress is saved there every checkpoint_interval chunks,
+	// run resumes from it if it is made for the same input and setting, it is removed when run is done.
+	// Used with ifname and ofname of files only, checksums cover only processed part of resumed run
+	std::string checkpoint;
+	int checkpoint_interval = 64;
+	// input bytes done by interrupted run and skipped by the last run
+	long long resumed_bytes = 0;
+	// only range [range_start, range_end) of input is processed(range_end = -1 - to the end of input),
+	// input must be able to seek, range_start and range_end(unless it is the end of input) must be multiples of BLOCKSIZE.
+	// Output is shard file(Shard_Header and processed range) or, with shared_output, the same range of ofname
+	// that is written by several processes at once. Not used with checkpoint
+	long long range_start = 0;
+	long long range_end = -1;
+	bool shared_output = false;
+	// pool for multithread mode, process-wide ThreadPoolMy::shared() is used if not set
+	ThreadPoolMy* thread_pool = nullptr;
+	// per-NUMA-node pools for multithread mode, used instead of thread_pool if set
+	Node_Pools* node_pools = nullptr;
+	// where parallel work of multithread mode goes(for example, scheduler of application), used instead of pools if set
+	Executor* executor = nullptr;
+	// precomputed key_schedules() for table engine(for example, cached by daemon), must match keys and modes
+	std::shared_ptr<const std::vector<Key_Schedule>> schedules;
 
 	int run();
+	void run_des(char* buffer, int blocks);
+	void run_buffer(char* buffer, int bytes);
 	int write_keys();
 	int read_keys();
+	// keys from stream in format of key file
+	int read_keys(std::istream& is);
 	void set_key(uint64_t key);
 	void set_3keys(uint64_t key1, uint64_t key2, uint64_t key3);
 	int get_key(int index, uint64_t& key) const;
 	inline int keys_size() const { return keys_number; }
+	inline bool ranged() const { return range_start > 0 || range_end >= 0; }
 	int set_triple_des_mode(int mode);
 	inline int get_triple_des_mode() const { return triple_des_mode; }
+	// 0 - DES, 1 + Triple_DES_Modes - Triple-DES
+	inline int cipher() const { return triple_des ? 1 + triple_des_mode : 0; }
+	// the first 3 bytes of processed zero block(key check value), tells keys and setting apart without revealing keys
+	uint32_t key_check();
+	std::vector<Key_Schedule> key_schedules() const;
+	// expands key schedules of table engine once for current keys and modes, so run_des doesn't do it on every call,
+	// run and run_buffer call it, callers of run_des from several threads(batch and so on) call it before
+	void prepare_schedules();
+	double block_cost_ns() const;
+	int parallel_portions(long long bytes, int max_portions) const;
 private:
 	int keys_number = 0;
 	std::array<uint64_t, 3> keys;
 	int triple_des_mode;
+	// schedules of prepare_schedules and setting they were made for
+	struct Schedule_Setting
+	{
+		std::array<uint64_t, 3> keys;
+		int keys_number;
+		int mode;
+		bool triple_des;
+		int triple_des_mode;
+		bool operator==(const Schedule_Setting& other) const = default;
+	};
+	std::shared_ptr<const std::vector<Key_Schedule>> prepared_schedules;
+	Schedule_Setting prepared_setting{};
+	Schedule_Setting schedule_setting() const;
 	uint64_t encrypt_tiple_des(char* buffer);
 	uint64_t decrypt_tiple_des(char* buffer);
-	void run_des(char* buffer, int blocks);
+	void run_des_table(char* buffer, int blocks);
+	int chunk_size() const;
+	int run_st(Byte_Reader& in, Byte_Writer& out);
+	// progress of resumable run
+	Checkpoint progress;
+	bool checkpointing = false;
+	void start_checkpoint();
+	bool tail_intact(const Checkpoint& saved) const;
+	void chunk_written(Byte_Writer& out, const char* buffer, int size, int data_bytes);
+	static double measure_block_cost_ns(bool triple, int engine);
 
 	//multithread features
-	int run_mt();
+	int run_mt(Byte_Reader& in, Byte_Writer& out);
+	int run_mt_numa(Byte_Reader& in, Byte_Writer& out);
+	ThreadPoolMy& compute_pool() const;
+	// checksums of one leaf of chunk
+	struct Leaf_Sums
+	{
+		uint64_t input;
+		uint64_t output;
+	};
+	void start_portions(Executor& ex, task_group& group, char* buffer, int bytes, int portions, int data_bytes, Leaf_Sums* sums);
+	void process_leaves(char* buffer, int offset, int bytes, int data_bytes, Leaf_Sums* sums);
+	void fold_checksums(const Leaf_Sums* sums, int data_bytes, int bytes);
 };
\ No newline at end of file
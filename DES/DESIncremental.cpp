@@ -0,0 +1,334 @@
+#include "stdafx.h"
+#include "DESIncremental.h"
+#include "DESTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <memory>
+#include <optional>
+
+namespace fs = std::filesystem;
+
+typedef std::chrono::steady_clock incremental_clock;
+
+static double seconds_since(incremental_clock::time_point& start)
+{
+	incremental_clock::time_point now = incremental_clock::now();
+	double seconds = std::chrono::duration<double>(now - start).count();
+	start = now;
+	return seconds;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+std::string manifest_name(const std::string& ofname)
+{
+	return ofname + ".chunks";
+}
+
+/*
+Written into temporary file and renamed, so manifest is either the old one or the whole new one
+*/
+bool save_manifest(const std::string& fname, const Chunk_Manifest& manifest)
+{
+	const std::string tmp = fname + ".tmp";
+	{
+		std::ofstream ofs(tmp);
+		ofs << "# DES manifest of chunks\n";
+		ofs << "mode=" << manifest.mode << "\n";
+		ofs << "cipher=" << manifest.cipher << "\n";
+		ofs << "key_check=" << std::hex << std::setfill('0') << std::setw(6) << manifest.key_check << std::dec << "\n";
+		ofs << "chunk_size=" << manifest.chunk_size << "\n";
+		ofs << "input_bytes=" << manifest.input_bytes << "\n";
+		ofs << "output_bytes=" << manifest.output_bytes << "\n";
+		ofs << "chunks=" << manifest.hashes.size() << "\n";
+		ofs << std::hex << std::setfill('0');
+		for (uint64_t hash : manifest.hashes)
+		{
+			ofs << std::setw(16) << hash << "\n";
+		}
+		if (!ofs)
+		{
+			return false;
+		}
+	}
+	std::error_code ec;
+	fs::rename(tmp, fname, ec);
+	return !ec;
+}
+
+bool load_manifest(const std::string& fname, Chunk_Manifest& manifest)
+{
+	std::ifstream ifs(fname);
+	if (!ifs)
+	{
+		return false;
+	}
+	manifest = Chunk_Manifest{};
+	long long chunks = -1;
+	std::string line;
+	try
+	{
+		while (chunks < 0 && std::getline(ifs, line))
+		{
+			size_t eq = line.find('=');
+			if (line.empty() || line[0] == '#' || eq == std::string::npos)
+			{
+				continue;
+			}
+			std::string key = line.substr(0, eq);
+			std::string value = line.substr(eq + 1);
+			if (key == "mode")
+			{
+				manifest.mode = std::stoi(value);
+			}
+			else if (key == "cipher")
+			{
+				manifest.cipher = std::stoi(value);
+			}
+			else if (key == "key_check")
+			{
+				manifest.key_check = (uint32_t)std::stoul(value, nullptr, 16);
+			}
+			else if (key == "chunk_size")
+			{
+				manifest.chunk_size = std::stoi(value);
+			}
+			else if (key == "input_bytes")
+			{
+				manifest.input_bytes = std::stoll(value);
+			}
+			else if (key == "output_bytes")
+			{
+				manifest.output_bytes = std::stoll(value);
+			}
+			else if (key == "chunks")
+			{
+				chunks = std::stoll(value);
+			}
+		}
+		// hashes follow the header
+		for (long long i = 0; i < chunks && std::getline(ifs, line); ++i)
+		{
+			manifest.hashes.push_back(std::stoull(line, nullptr, 16));
+		}
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+	return chunks >= 0 && (long long)manifest.hashes.size() == chunks && manifest.chunk_size > 0;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Chunks read at once, a task per chunk
+*/
+struct Chunk_Window
+{
+	std::vector<Pooled_Buffer> buffers;
+	std::vector<int> data_sizes;
+	std::vector<int> sizes;
+	std::vector<uint64_t> hashes;
+	std::vector<char> changed;
+	// index of the first chunk of window in file
+	long long first = 0;
+	int count = 0;
+	task_group tasks;
+};
+
+Incremental_Crypter::Incremental_Crypter(const File_Crypter& crypter_) : crypter(crypter_)
+{
+}
+
+/*
+Seed of chunk hashes: fixed block processed with keys of crypter.
+The same for every run with the same keys, unknown without them, so hashes in manifest
+don't let anyone holding output confirm guessed plaintext chunks.
+*/
+static uint64_t hash_seed(File_Crypter& fc)
+{
+	uint64_t block = 0x44455375486173ull;	// "DESuHas"
+	fc.run_des(reinterpret_cast<char*>(&block), 1);
+	return block;
+}
+
+int Incremental_Crypter::run()
+{
+	stats = Run_Stats{};
+	chunks = 0;
+	changed_chunks = 0;
+	if (crypter.ofname == "-")
+	{
+		return -1;
+	}
+	std::unique_ptr<Byte_Reader> in = open_reader(crypter.ifname, crypter.io);
+	if (!in)
+	{
+		return -1;
+	}
+	const int chunk = std::max(BLOCKSIZE, crypter.buffer_size - crypter.buffer_size % BLOCKSIZE);
+	const std::string manifest_file = manifest_name(crypter.ofname);
+	Chunk_Manifest manifest;
+	manifest.mode = crypter.mode;
+	manifest.cipher = crypter.cipher();
+	manifest.key_check = crypter.key_check();
+	crypter.prepare_schedules();
+	const uint64_t seed = hash_seed(crypter);
+	manifest.chunk_size = chunk;
+
+	// hashes of the previous run are valid only for the same setting and untouched output
+	Chunk_Manifest previous;
+	std::error_code ec;
+	full = !load_manifest(manifest_file, previous) || previous.mode != manifest.mode || previous.cipher != manifest.cipher
+		|| previous.key_check != manifest.key_check || previous.chunk_size != chunk
+		|| !fs::is_regular_file(crypter.ofname, ec) || (long long)fs::file_size(crypter.ofname, ec) != previous.output_bytes;
+	if (full)
+	{
+		previous.hashes.clear();
+	}
+	std::fstream out(crypter.ofname, full ? std::ios_base::out | std::ios_base::binary | std::ios_base::trunc
+		: std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+	if (!out)
+	{
+		return -1;
+	}
+	bool manifest_removed = false;
+
+	std::optional<Pool_Executor> pool_executor;
+	Inline_Executor inline_executor;
+	if (crypter.multithread && !crypter.executor)
+	{
+		pool_executor.emplace(thread_pool ? *thread_pool : ThreadPoolMy::shared());
+	}
+	Executor& ex = !crypter.multithread ? inline_executor : (crypter.executor ? *crypter.executor : *pool_executor);
+	const int width = std::max(1, ex.concurrency());
+	Chunk_Window windows[2];
+	for (Chunk_Window& window : windows)
+	{
+		window.buffers.resize(width);
+		window.data_sizes.resize(width);
+		window.sizes.resize(width);
+		window.hashes.resize(width);
+		window.changed.resize(width);
+	}
+	File_Crypter& fc = crypter;
+	const std::vector<uint64_t>& old_hashes = previous.hashes;
+
+	bool eof = false;
+	long long next_chunk = 0;
+	// reads the next chunks into window and starts their tasks
+	auto read_and_start = [&](Chunk_Window& window)
+	{
+		window.first = next_chunk;
+		window.count = 0;
+		while (!eof && window.count < width)
+		{
+			Pooled_Buffer& buffer = window.buffers[window.count];
+			if (!buffer.get())
+			{
+				buffer = Pooled_Buffer(chunk);
+			}
+			int got = read_chunk(*in, buffer.get(), chunk);
+			eof = got < chunk;
+			if (got == 0)
+			{
+				break;
+			}
+			stats.bytes += got;
+			window.data_sizes[window.count++] = got;
+		}
+		next_chunk += window.count;
+		ex.start(window.count, [&fc, &window, &old_hashes, seed](int i)
+		{
+			DES_TRACE_SPAN("run_des");
+			char* buffer = window.buffers[i].get();
+			window.hashes[i] = xxh64(buffer, window.data_sizes[i], seed);
+			long long index = window.first + i;
+			window.changed[i] = index >= (long long)old_hashes.size() || old_hashes[index] != window.hashes[i];
+			if (window.changed[i])
+			{
+				window.sizes[i] = pad_to_blocks(buffer, window.data_sizes[i]);
+				fc.run_des(buffer, window.sizes[i] / BLOCKSIZE);
+			}
+			else
+			{
+				window.sizes[i] = window.data_sizes[i] + (BLOCKSIZE - window.data_sizes[i] % BLOCKSIZE) % BLOCKSIZE;
+			}
+		}, window.tasks);
+	};
+
+	long long output_bytes = 0;
+	int cur = 0;
+	try
+	{
+		incremental_clock::time_point lap_start = incremental_clock::now();
+		read_and_start(windows[cur]);
+		stats.read_seconds += seconds_since(lap_start);
+		while (windows[cur].count)
+		{
+			Chunk_Window& window = windows[cur];
+			// next chunks are read while tasks of these ones work
+			read_and_start(windows[1 - cur]);
+			stats.read_seconds += seconds_since(lap_start);
+			{
+				DES_TRACE_SPAN("wait");
+				ex.wait(window.tasks);
+			}
+			stats.compute_seconds += seconds_since(lap_start);
+			for (int i = 0; i < window.count; ++i)
+			{
+				manifest.hashes.push_back(window.hashes[i]);
+				output_bytes += window.sizes[i];
+				if (!window.changed[i])
+				{
+					continue;
+				}
+				if (!manifest_removed)
+				{
+					std::remove(manifest_file.c_str());
+					manifest_removed = true;
+				}
+				DES_TRACE_SPAN("write");
+				out.seekp((window.first + i) * chunk);
+				out.write(window.buffers[i].get(), window.sizes[i]);
+				++changed_chunks;
+			}
+			if (!out)
+			{
+				throw std::runtime_error("could not write output file");
+			}
+			stats.write_seconds += seconds_since(lap_start);
+			cur = 1 - cur;
+		}
+	}
+	catch (const std::runtime_error&)
+	{
+		// workers must not touch buffers after they are released
+		ex.wait(windows[0].tasks);
+		ex.wait(windows[1].tasks);
+		return -1;
+	}
+	out.close();
+	if (!out)
+	{
+		return -1;
+	}
+	// input got shorter
+	if (!full && output_bytes < previous.output_bytes)
+	{
+		std::remove(manifest_file.c_str());
+		fs::resize_file(crypter.ofname, output_bytes, ec);
+		if (ec)
+		{
+			return -1;
+		}
+	}
+	chunks = manifest.hashes.size();
+	manifest.input_bytes = stats.bytes;
+	manifest.output_bytes = output_bytes;
+	return save_manifest(manifest_file, manifest) ? 0 : -1;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "DESFileCrypt.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Manifest of chunks of output file: setting it was made with and XXH64 of every input chunk(without padding)
+seeded with secret derived from keys, so hashes can't be checked against guessed plaintext without keys
+(XXH64 is not a MAC though, manifest should be kept as private as output).
+Kept next to output(output_file.chunks), key=value lines, then hash per line.
+*/
+struct Chunk_Manifest
+{
+	int mode = 0;
+	int cipher = 0;
+	// File_Crypter::key_check(), so changed keys aren't taken for the same output
+	uint32_t key_check = 0;
+	int chunk_size = 0;
+	long long input_bytes = 0;
+	long long output_bytes = 0;
+	std::vector<uint64_t> hashes;
+};
+
+std::string manifest_name(const std::string& ofname);
+bool save_manifest(const std::string& fname, const Chunk_Manifest& manifest);
+// false if file is missing or malformed
+bool load_manifest(const std::string& fname, Chunk_Manifest& manifest);
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Incremental processing for the same input file changing a bit between runs(snapshots, backups).
+Cipher is position independent(ECB), so every chunk of output depends only on the same chunk of input.
+Input is read chunk by chunk, tasks hash chunks and compare them with manifest of the previous run in parallel,
+only changed chunks are processed and written into output in place, output is truncated if input got shorter.
+Without valid manifest(first run, other keys or setting, output changed in size) the whole output is written.
+Manifest is removed before the first write and saved after the last one, so interrupted run is followed by the full one.
+*/
+class Incremental_Crypter
+{
+public:
+	// keys, mode, cipher, engine, buffer_size, io, multithread and executor are taken from crypter
+	explicit Incremental_Crypter(const File_Crypter& crypter_);
+
+	// pool for multithread mode if crypter has no executor, ThreadPoolMy::shared() if not set
+	ThreadPoolMy* thread_pool = nullptr;
+	// results of the last run: chunks of input, processed and written ones, whether the whole output was written
+	long long chunks = 0;
+	long long changed_chunks = 0;
+	bool full = false;
+	Run_Stats stats;
+
+	// returns -1 if input can't be opened or read, output can't be written or is stdout
+	int run();
+private:
+	File_Crypter crypter;
+};
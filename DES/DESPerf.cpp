@@ -0,0 +1,199 @@
+#include "stdafx.h"
+#include "DESPerf.h"
+#include <atomic>
+#include <cstring>
+#if defined(DES_PERF_COUNTERS) && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define DES_HAS_PERF_EVENT
+#endif
+
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static const char* region_names[PERF_REGIONS_COUNT] =
+{
+	"key schedule", "round loop", "permutation", "worker task", "file I/O"
+};
+
+// calls, cycles, instructions, cache misses, branch misses
+static std::atomic<uint64_t> totals[PERF_REGIONS_COUNT][5];
+
+const char* perf_region_name(Perf_Region region)
+{
+	return region_names[region];
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+#ifdef DES_HAS_PERF_EVENT
+/*
+Counters group of one thread: cycles(leader), instructions, cache misses, branch misses.
+Opened on first use in the thread and closed when thread exits.
+If kernel does not allow counters(perf_event_paranoid, containers), group stays invalid.
+*/
+class Perf_Group
+{
+public:
+	Perf_Group()
+	{
+		const uint64_t configs[4] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+		for (int i = 0; i < 4; ++i)
+		{
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.read_format = PERF_FORMAT_GROUP;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+			if (fds[i] < 0)
+			{
+				close_all();
+				return;
+			}
+		}
+	}
+	~Perf_Group()
+	{
+		close_all();
+	}
+	bool valid() const
+	{
+		return fds[0] >= 0;
+	}
+	/*
+	Returns false on error
+	*/
+	bool read_values(uint64_t values[4]) const
+	{
+		// PERF_FORMAT_GROUP: number of counters, then their values
+		uint64_t buffer[5];
+		if (!valid() || read(fds[0], buffer, sizeof(buffer)) != sizeof(buffer))
+		{
+			return false;
+		}
+		memcpy(values, buffer + 1, 4 * sizeof(uint64_t));
+		return true;
+	}
+private:
+	void close_all()
+	{
+		for (int& fd : fds)
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			fd = -1;
+		}
+	}
+	int fds[4] = { -1, -1, -1, -1 };
+};
+
+static Perf_Group& thread_group()
+{
+	thread_local Perf_Group group;
+	return group;
+}
+#endif
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+#ifdef DES_PERF_COUNTERS
+Perf_Scope::Perf_Scope(Perf_Region region_)
+	: region{ region_ }, active{ false }
+{
+#ifdef DES_HAS_PERF_EVENT
+	active = thread_group().read_values(start);
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Perf_Scope::~Perf_Scope()
+{
+#ifdef DES_HAS_PERF_EVENT
+	uint64_t finish[4];
+	if (!active || !thread_group().read_values(finish))
+	{
+		return;
+	}
+	totals[region][0].fetch_add(1, std::memory_order_relaxed);
+	for (int i = 0; i < 4; ++i)
+	{
+		totals[region][i + 1].fetch_add(finish[i] - start[i], std::memory_order_relaxed);
+	}
+#endif
+}
+#endif
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Returns true if counters can be read in calling thread
+*/
+bool perf_counters_available()
+{
+#ifdef DES_HAS_PERF_EVENT
+	return thread_group().valid();
+#else
+	return false;
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Perf_Counts perf_counts(Perf_Region region)
+{
+	Perf_Counts counts;
+	counts.calls = totals[region][0].load();
+	counts.cycles = totals[region][1].load();
+	counts.instructions = totals[region][2].load();
+	counts.cache_misses = totals[region][3].load();
+	counts.branch_misses = totals[region][4].load();
+	return counts;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void perf_reset()
+{
+	for (auto& region : totals)
+	{
+		for (auto& value : region)
+		{
+			value.store(0);
+		}
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Prints table: region, calls, cycles, instructions, IPC, cache and branch misses
+*/
+void perf_report(std::ostream& os)
+{
+#ifndef DES_PERF_COUNTERS
+	os << "Performance counters: not compiled in(define DES_PERF_COUNTERS)\n";
+#else
+	if (!perf_counters_available())
+	{
+		os << "Performance counters: not available(check /proc/sys/kernel/perf_event_paranoid)\n";
+		return;
+	}
+	os << "Region\tcalls\tcycles\tinstructions\tIPC\tcache misses\tbranch misses\n";
+	for (int i = 0; i < PERF_REGIONS_COUNT; ++i)
+	{
+		Perf_Counts counts = perf_counts((Perf_Region)i);
+		double ipc = counts.cycles ? (double)counts.instructions / counts.cycles : 0;
+		os << perf_region_name((Perf_Region)i) << "\t" << counts.calls << "\t" << counts.cycles << "\t"
+			<< counts.instructions << "\t" << ipc << "\t" << counts.cache_misses << "\t" << counts.branch_misses << "\n";
+	}
+#endif
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <ostream>
+#include <stdint.h>
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Hardware performance counters of hot regions(Linux perf_event_open).
+	Compiled in only with DES_PERF_COUNTERS defined, otherwise DES_PERF_SCOPE expands to nothing
+	and perf_counters_available() returns false.
+	Counts are inclusive: rounds region contains key schedule and permutations done inside of it.
+	Every scope reads counters twice(one syscall each), so instrumented build is much slower
+	and absolute numbers of small regions include that overhead, ratios(IPC, misses per call) stay useful.
+*/
+enum Perf_Region
+{
+	PERF_KEY_SCHEDULE,
+	PERF_ROUNDS,
+	PERF_PERMUTATION,
+	PERF_WORKER_TASK,
+	PERF_FILE_IO,
+	PERF_REGIONS_COUNT
+};
+
+struct Perf_Counts
+{
+	uint64_t calls = 0;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t cache_misses = 0;
+	uint64_t branch_misses = 0;
+};
+
+#ifdef DES_PERF_COUNTERS
+
+/*
+	Adds counters delta between construction and destruction to region totals
+*/
+class Perf_Scope
+{
+public:
+	explicit Perf_Scope(Perf_Region region_);
+	~Perf_Scope();
+	Perf_Scope(const Perf_Scope&) = delete;
+	Perf_Scope& operator=(const Perf_Scope&) = delete;
+private:
+	Perf_Region region;
+	bool active;
+	uint64_t start[4];
+};
+
+#define DES_PERF_CONCAT_(a, b) a##b
+#define DES_PERF_CONCAT(a, b) DES_PERF_CONCAT_(a, b)
+#define DES_PERF_SCOPE(region) Perf_Scope DES_PERF_CONCAT(perf_scope_, __LINE__)(region)
+
+#else
+
+#define DES_PERF_SCOPE(region)
+
+#endif
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+bool perf_counters_available();
+const char* perf_region_name(Perf_Region region);
+Perf_Counts perf_counts(Perf_Region region);
+void perf_reset();
+void perf_report(std::ostream& os);
@@ -0,0 +1,126 @@
+#include "stdafx.h"
+#include "DESShard.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static const char SHARD_MAGIC[8] = { 'D', 'E', 'S', 'S', 'H', 'R', 'D', '1' };
+// the same as BLOCKSIZE of File_Crypter
+static const int SHARD_ALIGN = 8;
+static const int MERGE_BUFFER = 1024 * 1024;
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void write_shard_header(Byte_Writer& out, const Shard_Header& header)
+{
+	char buffer[SHARD_HEADER_SIZE];
+	memcpy(buffer, SHARD_MAGIC, sizeof(SHARD_MAGIC));
+	memcpy(buffer + 8, &header.start, sizeof(long long));
+	memcpy(buffer + 16, &header.end, sizeof(long long));
+	memcpy(buffer + 24, &header.input_bytes, sizeof(long long));
+	out.write(buffer, SHARD_HEADER_SIZE);
+}
+
+bool read_shard_header(Byte_Reader& in, Shard_Header& header)
+{
+	char buffer[SHARD_HEADER_SIZE];
+	if (in.read(buffer, SHARD_HEADER_SIZE) != SHARD_HEADER_SIZE || memcmp(buffer, SHARD_MAGIC, sizeof(SHARD_MAGIC)))
+	{
+		return false;
+	}
+	memcpy(&header.start, buffer + 8, sizeof(long long));
+	memcpy(&header.end, buffer + 16, sizeof(long long));
+	memcpy(&header.input_bytes, buffer + 24, sizeof(long long));
+	return 0 <= header.start && header.start <= header.end && header.end <= header.input_bytes;
+}
+
+void shard_range(long long input_bytes, int index, int count, long long& start, long long& end)
+{
+	long long per_shard = (input_bytes + count - 1) / count;
+	per_shard = (per_shard + SHARD_ALIGN - 1) / SHARD_ALIGN * SHARD_ALIGN;
+	start = std::min(input_bytes, per_shard * index);
+	end = index == count - 1 ? input_bytes : std::min(input_bytes, start + per_shard);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+struct Shard_File
+{
+	std::string fname;
+	Shard_Header header;
+};
+
+int merge_shards(const std::vector<std::string>& shards, const std::string& ofname, std::string& error)
+{
+	std::vector<Shard_File> files;
+	for (const std::string& fname : shards)
+	{
+		std::unique_ptr<Byte_Reader> in = open_reader(fname);
+		Shard_File file{ fname, Shard_Header{} };
+		if (!in || !read_shard_header(*in, file.header))
+		{
+			error = fname + " is not a shard";
+			return -1;
+		}
+		// only the last range is padded
+		long long range = file.header.end - file.header.start;
+		if (file.header.end == file.header.input_bytes)
+		{
+			range = (range + SHARD_ALIGN - 1) / SHARD_ALIGN * SHARD_ALIGN;
+		}
+		if (in->size() - SHARD_HEADER_SIZE != range)
+		{
+			error = fname + " is shorter or longer than its range";
+			return -1;
+		}
+		files.push_back(file);
+	}
+	std::sort(files.begin(), files.end(), [](const Shard_File& a, const Shard_File& b) { return a.header.start < b.header.start; });
+	long long covered = 0;
+	for (const Shard_File& file : files)
+	{
+		if (file.header.input_bytes != files.front().header.input_bytes || file.header.start != covered)
+		{
+			error = file.fname + " doesn't continue previous shards";
+			return -1;
+		}
+		covered = file.header.end;
+	}
+	if (files.empty() || covered != files.front().header.input_bytes)
+	{
+		error = "shards don't cover the whole input";
+		return -1;
+	}
+
+	std::unique_ptr<Byte_Writer> out = open_writer(ofname);
+	if (!out)
+	{
+		error = "could not open " + ofname;
+		return -1;
+	}
+	std::vector<char> buffer(MERGE_BUFFER);
+	try
+	{
+		for (const Shard_File& file : files)
+		{
+			std::unique_ptr<Byte_Reader> in = open_reader(file.fname);
+			if (!in || !in->seek(SHARD_HEADER_SIZE))
+			{
+				error = "could not read " + file.fname;
+				return -1;
+			}
+			int got;
+			while ((got = in->read(buffer.data(), MERGE_BUFFER)) > 0)
+			{
+				out->write(buffer.data(), got);
+			}
+		}
+		out->flush();
+	}
+	catch (const std::runtime_error& err)
+	{
+		error = err.what();
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "DESStream.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Header of shard file: range [start, end) of input it is made of and size of the whole input.
+Processed range follows it(padded to blocks if it is the last one).
+Stored as magic and three 64-bit integers of the host, SHARD_HEADER_SIZE bytes.
+*/
+struct Shard_Header
+{
+	long long start = 0;
+	long long end = 0;
+	long long input_bytes = 0;
+};
+
+const int SHARD_HEADER_SIZE = 32;
+
+void write_shard_header(Byte_Writer& out, const Shard_Header& header);
+// false if file is too short or not a shard
+bool read_shard_header(Byte_Reader& in, Shard_Header& header);
+
+/*
+Block aligned range of shard 'index' of 'count' for input of input_bytes, ranges of all shards cover input
+*/
+void shard_range(long long input_bytes, int index, int count, long long& start, long long& end);
+
+/*
+Concatenates processed ranges of shard files into ofname in order of their ranges.
+Returns -1 and error if shards can't be read, overlap, leave gap, don't cover the whole input
+or their length doesn't match their range.
+*/
+int merge_shards(const std::vector<std::string>& shards, const std::string& ofname, std::string& error);
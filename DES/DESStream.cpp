@@ -0,0 +1,313 @@
+#include "stdafx.h"
+#include "DESStream.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+const char* io_name(int backend)
+{
+	return backend == IO_FD ? "fd" : "stream";
+}
+
+int parse_io(const std::string& name)
+{
+	if (name == "stream")
+	{
+		return IO_STREAM;
+	}
+	if (name == "fd")
+	{
+		return IO_FD;
+	}
+	return -1;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Stream_Reader::Stream_Reader(const std::string& fname)
+	: ifs(fname, std::ios_base::binary | std::ios_base::ate)
+{
+	if (ifs)
+	{
+		_size = ifs.tellg();
+		ifs.seekg(0, std::ios_base::beg);
+	}
+}
+
+int Stream_Reader::read(char* buffer, int size)
+{
+	ifs.read(buffer, size);
+	if (ifs.bad())
+	{
+		throw std::runtime_error("could not read input");
+	}
+	return (int)ifs.gcount();
+}
+
+bool Stream_Reader::seek(long long offset)
+{
+	ifs.clear();
+	ifs.seekg(offset, std::ios_base::beg);
+	return (bool)ifs;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Stream_Writer::Stream_Writer(const std::string& fname, long long offset)
+{
+	if (offset < 0)
+	{
+		ofs.open(fname, std::ios_base::binary);
+		return;
+	}
+	// in|out doesn't create file, app does and doesn't truncate it
+	{
+		std::ofstream create(fname, std::ios_base::binary | std::ios_base::app);
+	}
+	ofs.open(fname, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+	ofs.seekp(offset, std::ios_base::beg);
+}
+
+void Stream_Writer::write(const char* buffer, int size)
+{
+	ofs.write(buffer, size);
+	if (!ofs)
+	{
+		throw std::runtime_error("could not write output");
+	}
+}
+
+void Stream_Writer::flush()
+{
+	if (!ofs.flush())
+	{
+		throw std::runtime_error("could not write output");
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+int Range_Reader::read(char* buffer, int size)
+{
+	int got = in.read(buffer, (int)std::min<long long>(size, left));
+	left -= got;
+	return got;
+}
+
+#ifndef _WIN32
+/*-------------------------------------------------------------------------------------------------------*/
+
+// kernel buffer asked for pipes, a chunk of default size
+static const int PIPE_SIZE = 1024 * 1024;
+
+static void enlarge_pipe(int fd)
+{
+#ifdef F_SETPIPE_SZ
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+	{
+		fcntl(fd, F_SETPIPE_SZ, PIPE_SIZE);
+	}
+#else
+	(void)fd;
+#endif
+}
+
+Fd_Reader::Fd_Reader(int fd_, bool owned_)
+	: fd{ fd_ }, owned{ owned_ }
+{
+	enlarge_pipe(fd);
+}
+
+Fd_Reader::~Fd_Reader()
+{
+	if (owned)
+	{
+		close(fd);
+	}
+}
+
+int Fd_Reader::read(char* buffer, int size)
+{
+	int done = 0;
+	while (done < size)
+	{
+		ssize_t got = ::read(fd, buffer + done, size - done);
+		if (got < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (got < 0)
+		{
+			throw std::runtime_error(std::string("could not read input: ") + strerror(errno));
+		}
+		if (got == 0)
+		{
+			break;
+		}
+		done += got;
+	}
+	return done;
+}
+
+long long Fd_Reader::size() const
+{
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+	{
+		return st.st_size;
+	}
+	return -1;
+}
+
+bool Fd_Reader::seek(long long offset)
+{
+	return lseek(fd, offset, SEEK_SET) == offset;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Fd_Writer::Fd_Writer(int fd_, bool owned_)
+	: fd{ fd_ }, owned{ owned_ }
+{
+	enlarge_pipe(fd);
+}
+
+Fd_Writer::~Fd_Writer()
+{
+	if (owned)
+	{
+		close(fd);
+	}
+}
+
+void Fd_Writer::write(const char* buffer, int size)
+{
+	while (size > 0)
+	{
+		ssize_t sent = ::write(fd, buffer, size);
+		if (sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (sent < 0)
+		{
+			throw std::runtime_error(std::string("could not write output: ") + strerror(errno));
+		}
+		buffer += sent;
+		size -= sent;
+	}
+}
+
+#else
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+stdin/stdout of Windows, switched to binary mode
+*/
+class Stdin_Reader : public Byte_Reader
+{
+public:
+	Stdin_Reader() { _setmode(_fileno(stdin), _O_BINARY); }
+	int read(char* buffer, int size) override
+	{
+		size_t got = fread(buffer, 1, size, stdin);
+		if (ferror(stdin))
+		{
+			throw std::runtime_error("could not read input");
+		}
+		return (int)got;
+	}
+};
+
+class Stdout_Writer : public Byte_Writer
+{
+public:
+	Stdout_Writer() { _setmode(_fileno(stdout), _O_BINARY); }
+	~Stdout_Writer() { fflush(stdout); }
+	void write(const char* buffer, int size) override
+	{
+		if (fwrite(buffer, 1, size, stdout) != (size_t)size)
+		{
+			throw std::runtime_error("could not write output");
+		}
+	}
+};
+#endif
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+std::unique_ptr<Byte_Reader> open_reader(const std::string& name, int backend)
+{
+#ifndef _WIN32
+	if (name == "-")
+	{
+		return std::unique_ptr<Byte_Reader>(new Fd_Reader(STDIN_FILENO, false));
+	}
+	if (backend == IO_FD)
+	{
+		int fd = open(name.c_str(), O_RDONLY);
+		return fd < 0 ? nullptr : std::unique_ptr<Byte_Reader>(new Fd_Reader(fd, true));
+	}
+#else
+	if (name == "-")
+	{
+		return std::unique_ptr<Byte_Reader>(new Stdin_Reader());
+	}
+#endif
+	std::unique_ptr<Stream_Reader> reader(new Stream_Reader(name));
+	return reader->is_open() ? std::move(reader) : nullptr;
+}
+
+std::unique_ptr<Byte_Writer> open_writer(const std::string& name, int backend)
+{
+#ifndef _WIN32
+	if (name == "-")
+	{
+		return std::unique_ptr<Byte_Writer>(new Fd_Writer(STDOUT_FILENO, false));
+	}
+	if (backend == IO_FD)
+	{
+		int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		return fd < 0 ? nullptr : std::unique_ptr<Byte_Writer>(new Fd_Writer(fd, true));
+	}
+#else
+	if (name == "-")
+	{
+		return std::unique_ptr<Byte_Writer>(new Stdout_Writer());
+	}
+#endif
+	std::unique_ptr<Stream_Writer> writer(new Stream_Writer(name));
+	return writer->is_open() ? std::move(writer) : nullptr;
+}
+
+std::unique_ptr<Byte_Writer> open_writer_at(const std::string& name, long long offset, int backend)
+{
+#ifndef _WIN32
+	if (backend == IO_FD)
+	{
+		int fd = open(name.c_str(), O_WRONLY | O_CREAT, 0644);
+		if (fd >= 0 && lseek(fd, offset, SEEK_SET) != offset)
+		{
+			close(fd);
+			return nullptr;
+		}
+		return fd < 0 ? nullptr : std::unique_ptr<Byte_Writer>(new Fd_Writer(fd, true));
+	}
+#endif
+	std::unique_ptr<Stream_Writer> writer(new Stream_Writer(name, offset));
+	return writer->is_open() ? std::move(writer) : nullptr;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <fstream>
+#include <memory>
+#include <string>
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Source of bytes for File_Crypter: file, pipe or socket.
+read fills buffer completely unless input ends, so only the last chunk is short(and padded).
+Errors are thrown as std::runtime_error.
+*/
+class Byte_Reader
+{
+public:
+	virtual ~Byte_Reader() {}
+	virtual int read(char* buffer, int size) = 0;
+	// -1 if size is not known(pipes, sockets)
+	virtual long long size() const { return -1; }
+	// moves to offset from the beginning, false if input can't seek(pipes, sockets)
+	virtual bool seek(long long) { return false; }
+};
+
+/*
+Destination of bytes, errors are thrown as std::runtime_error
+*/
+class Byte_Writer
+{
+public:
+	virtual ~Byte_Writer() {}
+	virtual void write(const char* buffer, int size) = 0;
+	// hands written data to system, so it survives the process
+	virtual void flush() {}
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+// IO_STREAM - std::fstream, IO_FD - read/write of file descriptor(POSIX only, IO_STREAM elsewhere)
+enum Io_Backends { IO_STREAM, IO_FD };
+
+const char* io_name(int backend);
+// -1 if name is unknown
+int parse_io(const std::string& name);
+
+/*
+"-" is stdin/stdout, other names are opened with backend.
+nullptr if file could not be opened.
+*/
+std::unique_ptr<Byte_Reader> open_reader(const std::string& name, int backend = IO_STREAM);
+std::unique_ptr<Byte_Writer> open_writer(const std::string& name, int backend = IO_STREAM);
+// file is created if it doesn't exist, not truncated, writing starts from offset
+std::unique_ptr<Byte_Writer> open_writer_at(const std::string& name, long long offset, int backend = IO_STREAM);
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+class Stream_Reader : public Byte_Reader
+{
+public:
+	explicit Stream_Reader(const std::string& fname);
+	inline bool is_open() const { return (bool)ifs; }
+	int read(char* buffer, int size) override;
+	long long size() const override { return _size; }
+	bool seek(long long offset) override;
+private:
+	std::ifstream ifs;
+	long long _size = -1;
+};
+
+class Stream_Writer : public Byte_Writer
+{
+public:
+	// offset >= 0 - existing file is kept, writing starts from offset
+	explicit Stream_Writer(const std::string& fname, long long offset = -1);
+	inline bool is_open() const { return (bool)ofs; }
+	void write(const char* buffer, int size) override;
+	void flush() override;
+private:
+	std::ofstream ofs;
+};
+
+/*
+First 'length' bytes of other reader from its current position(range of input)
+*/
+class Range_Reader : public Byte_Reader
+{
+public:
+	Range_Reader(Byte_Reader& in_, long long length_) : in(in_), left{ length_ }, length{ length_ } {}
+	int read(char* buffer, int size) override;
+	long long size() const override { return length; }
+private:
+	Byte_Reader& in;
+	long long left;
+	long long length;
+};
+
+#ifndef _WIN32
+/*
+Descriptor of file, pipe or socket. Reads loop until buffer is full, so pipes give whole chunks too.
+Pipes get bigger kernel buffer(F_SETPIPE_SZ) where kernel allows, so chunk goes with few context switches.
+Descriptor is closed on destruction if owned.
+*/
+class Fd_Reader : public Byte_Reader
+{
+public:
+	Fd_Reader(int fd_, bool owned_);
+	~Fd_Reader();
+	int read(char* buffer, int size) override;
+	long long size() const override;
+	bool seek(long long offset) override;
+private:
+	int fd;
+	bool owned;
+};
+
+class Fd_Writer : public Byte_Writer
+{
+public:
+	Fd_Writer(int fd_, bool owned_);
+	~Fd_Writer();
+	void write(const char* buffer, int size) override;
+private:
+	int fd;
+	bool owned;
+};
+#endif
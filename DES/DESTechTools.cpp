@@ -1,5 +1,20 @@
 #include "stdafx.h"
 #include "DESTechTools.h"
+#include "DESBufferPool.h"
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define DES_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define DES_HAS_RDTSC
+#endif
 
 /*
 generates 56 bits password from first 7 bytes of entered string
@@ -67,8 +82,8 @@ bool are_files_equal(const std::string& fname1, const std::string& fname2, bool
 	}
 
 	//comparing block_by_block
-	std::unique_ptr<char[]> block1(new char[BLOCK_SIZE]);
-	std::unique_ptr<char[]> block2(new char[BLOCK_SIZE]);
+	Pooled_Buffer block1(BLOCK_SIZE);
+	Pooled_Buffer block2(BLOCK_SIZE);
 	if (exclude_last_zeros)
 	{
 		memset(block1.get(), 0, BLOCK_SIZE);
@@ -94,4 +109,59 @@ bool are_files_equal(const std::string& fname1, const std::string& fname2, bool
 		ifs2.read(block2.get(), BLOCK_SIZE);
 	}
 	return true;
+}
+
+/*
+Returns size of file in bytes, -1 if file can not be opened
+*/
+long long get_file_size(const std::string& fname)
+{
+	std::ifstream ifs;
+	ifs.open(fname, std::ios_base::binary | std::ios_base::ate);
+	if (!ifs)
+	{
+		return -1;
+	}
+	return (long long)ifs.tellg();
+}
+
+/*
+CPU time stamp counter(rdtsc) for cycles per byte measurements.
+On platforms without it returns nanoseconds of steady clock.
+*/
+uint64_t read_cycle_counter()
+{
+#ifdef DES_HAS_RDTSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/*
+CPU time used by all threads of the process, in seconds
+(std::clock() is wall time on Windows, so it is not used there).
+*/
+double process_cpu_seconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+	{
+		ULARGE_INTEGER k, u;
+		k.LowPart = kernel.dwLowDateTime;
+		k.HighPart = kernel.dwHighDateTime;
+		u.LowPart = user.dwLowDateTime;
+		u.HighPart = user.dwHighDateTime;
+		// 100 ns units
+		return (k.QuadPart + u.QuadPart) / 1e7;
+	}
+	return 0;
+#elif defined(CLOCK_PROCESS_CPUTIME_ID)
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
 }
\ No newline at end of file
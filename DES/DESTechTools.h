@@ -19,4 +19,7 @@ state codes:
 */
 uint64_t password_from_string_to_uint64(const std::string& password, int& state);
 uint64_t generate_random64();
-bool are_files_equal(const std::string& fname1, const std::string& fname2, bool exclude_last_zeros = false);
\ No newline at end of file
+bool are_files_equal(const std::string& fname1, const std::string& fname2, bool exclude_last_zeros = false);
+long long get_file_size(const std::string& fname);
+uint64_t read_cycle_counter();
+double process_cpu_seconds();
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "stdafx.h"
+#include "DESTrace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+#ifdef DES_TRACE
+/*-------------------------------------------------------------------------------------------------------*/
+
+static const int TRACE_BUFFER_SIZE = 1 << 15;
+
+static std::atomic<bool> trace_enabled{ false };
+
+static int64_t trace_now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Trace_Event
+{
+	const char* name;
+	int64_t start_ns;
+	int64_t duration_ns;
+};
+
+/*
+Ring buffer of one thread.
+Only owner thread writes, head is published with release so trace_write sees complete events.
+*/
+struct Trace_Buffer
+{
+	int tid;
+	std::atomic<uint64_t> head{ 0 };
+	std::vector<Trace_Event> events = std::vector<Trace_Event>(TRACE_BUFFER_SIZE);
+};
+
+/*
+Buffers of all threads that recorded spans.
+They are never freed before exit, so spans of finished threads(for example, workers of destroyed pool) are kept.
+*/
+struct Trace_Registry
+{
+	std::mutex mtx;
+	std::vector<std::unique_ptr<Trace_Buffer>> buffers;
+	std::string exit_fname;
+};
+
+static Trace_Registry& registry()
+{
+	static Trace_Registry reg;
+	return reg;
+}
+
+static Trace_Buffer& thread_buffer()
+{
+	thread_local Trace_Buffer* buffer = nullptr;
+	if (!buffer)
+	{
+		Trace_Registry& reg = registry();
+		std::lock_guard<std::mutex> lck{ reg.mtx };
+		reg.buffers.emplace_back(new Trace_Buffer);
+		buffer = reg.buffers.back().get();
+		buffer->tid = reg.buffers.size();
+	}
+	return *buffer;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Trace_Span::Trace_Span(const char* name_)
+	: name{ name_ }, start_ns{ trace_enabled.load(std::memory_order_relaxed) ? trace_now_ns() : 0 }
+{
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Trace_Span::~Trace_Span()
+{
+	if (!start_ns)
+	{
+		return;
+	}
+	Trace_Buffer& buffer = thread_buffer();
+	uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	buffer.events[head % TRACE_BUFFER_SIZE] = Trace_Event{ name, start_ns, trace_now_ns() - start_ns };
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static void write_at_exit()
+{
+	trace_write(registry().exit_fname);
+}
+#endif
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Starts recording of spans.
+Returns false if tracer is not compiled in.
+*/
+bool trace_enable()
+{
+#ifdef DES_TRACE
+	registry();
+	trace_enabled = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void trace_disable()
+{
+#ifdef DES_TRACE
+	trace_enabled = false;
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Writes recorded spans as Chrome trace-event JSON.
+Spans that are being recorded at the moment may be missed.
+Returns false if file could not be written or tracer is not compiled in.
+*/
+bool trace_write(const std::string& fname)
+{
+#ifdef DES_TRACE
+	std::ofstream ofs(fname);
+	ofs << std::fixed << std::setprecision(3);
+	ofs << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+	Trace_Registry& reg = registry();
+	std::lock_guard<std::mutex> lck{ reg.mtx };
+	bool first = true;
+	for (const auto& buffer : reg.buffers)
+	{
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t begin = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+		for (uint64_t i = begin; i < head; ++i)
+		{
+			const Trace_Event& ev = buffer->events[i % TRACE_BUFFER_SIZE];
+			ofs << (first ? "" : ",\n") << "{\"name\": \"" << ev.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+				<< ", \"ts\": " << ev.start_ns / 1000.0 << ", \"dur\": " << ev.duration_ns / 1000.0 << "}";
+			first = false;
+		}
+	}
+	ofs << "\n]}\n";
+	return (bool)ofs;
+#else
+	(void)fname;
+	return false;
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Enables tracing and writes spans into fname when program exits.
+Returns false if tracer is not compiled in.
+*/
+bool trace_write_at_exit(const std::string& fname)
+{
+#ifdef DES_TRACE
+	registry().exit_fname = fname;
+	std::atexit(write_at_exit);
+	return trace_enable();
+#else
+	(void)fname;
+	return false;
+#endif
+}
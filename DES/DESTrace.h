@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Timeline tracer: spans of every thread in Chrome trace-event JSON(chrome://tracing, ui.perfetto.dev).
+	Compiled in only with DES_TRACE defined, otherwise DES_TRACE_SPAN expands to nothing.
+	Recording starts with trace_enable(), every thread writes its spans into its own ring buffer
+	without locks(oldest spans are overwritten when it is full).
+	Span name must be string literal(only pointer is stored).
+*/
+#ifdef DES_TRACE
+
+class Trace_Span
+{
+public:
+	explicit Trace_Span(const char* name_);
+	~Trace_Span();
+	Trace_Span(const Trace_Span&) = delete;
+	Trace_Span& operator=(const Trace_Span&) = delete;
+private:
+	const char* name;
+	int64_t start_ns;
+};
+
+#define DES_TRACE_CONCAT_(a, b) a##b
+#define DES_TRACE_CONCAT(a, b) DES_TRACE_CONCAT_(a, b)
+#define DES_TRACE_SPAN(name) Trace_Span DES_TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#else
+
+#define DES_TRACE_SPAN(name)
+
+#endif
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+bool trace_enable();
+void trace_disable();
+bool trace_write(const std::string& fname);
+bool trace_write_at_exit(const std::string& fname);
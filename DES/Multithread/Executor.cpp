@@ -0,0 +1,50 @@
+#include "stdafx.h"
+#include "Executor.h"
+#include <memory>
+
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void Executor::bulk_execute(int count, const std::function<void(int)>& f)
+{
+	task_group group;
+	start(count, f, group);
+	wait(group);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+int Pool_Executor::concurrency() const
+{
+	return pool.size() + 1;
+}
+
+void Pool_Executor::start(int count, const std::function<void(int)>& f, task_group& group)
+{
+	// tasks outlive start, so they share their copy of f
+	std::shared_ptr<const std::function<void(int)>> shared = std::make_shared<const std::function<void(int)>>(f);
+	for (int i = 0; i < count; ++i)
+	{
+		pool.wait_do_task([shared, i]() { (*shared)(i); }, group);
+	}
+}
+
+void Pool_Executor::wait(task_group& group)
+{
+	pool.wait_group(group);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void Inline_Executor::start(int count, const std::function<void(int)>& f, task_group&)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		f(i);
+	}
+}
+
+void Callback_Executor::start(int count, const std::function<void(int)>& f, task_group&)
+{
+	bulk(count, f);
+}
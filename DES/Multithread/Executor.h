@@ -0,0 +1,68 @@
+#pragma once
+#include <functional>
+#include "ThreadPoolMy.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Where parallel work of File_Crypter and Batch_Crypter goes.
+	start begins bulk of tasks f(0), ..., f(count - 1), they may run in parallel, even before start returns.
+	wait returns when all tasks started with group are done, waiting thread may do some of them.
+	So caller can start a bulk, do something else(I/O) and wait for it later.
+*/
+class Executor
+{
+public:
+	virtual ~Executor() {}
+	// number of tasks worth running at once, waiting thread included
+	virtual int concurrency() const = 0;
+	virtual void start(int count, const std::function<void(int)>& f, task_group& group) = 0;
+	virtual void wait(task_group& group) = 0;
+	// start and wait
+	void bulk_execute(int count, const std::function<void(int)>& f);
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Tasks go to workers of ThreadPoolMy, waiting thread helps them(wait_group)
+*/
+class Pool_Executor : public Executor
+{
+public:
+	explicit Pool_Executor(ThreadPoolMy& pool_) : pool(pool_) {}
+	int concurrency() const override;
+	void start(int count, const std::function<void(int)>& f, task_group& group) override;
+	void wait(task_group& group) override;
+private:
+	ThreadPoolMy& pool;
+};
+
+/*
+	Serial execution: start does all tasks in calling thread
+*/
+class Inline_Executor : public Executor
+{
+public:
+	int concurrency() const override { return 1; }
+	void start(int count, const std::function<void(int)>& f, task_group& group) override;
+	void wait(task_group&) override {}
+};
+
+/*
+	Bulk goes to scheduler of caller(TBB parallel_for, own pool and so on) through callback,
+	that runs f(0), ..., f(count - 1) and returns when all are done.
+	Callback is called from start, so I/O of File_Crypter doesn't overlap with processing then.
+*/
+class Callback_Executor : public Executor
+{
+public:
+	typedef std::function<void(int count, const std::function<void(int)>& f)> Bulk_Fn;
+	Callback_Executor(Bulk_Fn bulk_, int concurrency_) : bulk(std::move(bulk_)), _concurrency(concurrency_) {}
+	int concurrency() const override { return _concurrency; }
+	void start(int count, const std::function<void(int)>& f, task_group& group) override;
+	void wait(task_group&) override {}
+private:
+	Bulk_Fn bulk;
+	int _concurrency;
+};
@@ -0,0 +1,158 @@
+#include "stdafx.h"
+#include "PoolMetrics.h"
+#include <algorithm>
+
+
+/*------------------------------------------HISTOGRAM----------------------------------------------------*/
+
+Latency_Histogram::Latency_Histogram()
+{
+	reset();
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Values below SUB_BUCKETS have their own buckets,
+bigger values go to one of SUB_BUCKETS buckets of their power of two.
+*/
+int Latency_Histogram::bucket_of(uint64_t value)
+{
+	if (value < SUB_BUCKETS)
+	{
+		return (int)value;
+	}
+	int exponent = 63;
+	while (!(value >> exponent))
+	{
+		--exponent;
+	}
+	int shift = exponent - SUB_BUCKET_BITS;
+	int sub = (int)((value >> shift) & (SUB_BUCKETS - 1));
+	return SUB_BUCKETS + shift * SUB_BUCKETS + sub;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+uint64_t Latency_Histogram::bucket_upper_bound(int bucket)
+{
+	if (bucket < SUB_BUCKETS)
+	{
+		return bucket;
+	}
+	int shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+	uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+	return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void Latency_Histogram::record(int64_t value)
+{
+	uint64_t v = value < 0 ? 0 : (uint64_t)value;
+	counts[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(v, std::memory_order_relaxed);
+	uint64_t old_max = max.load(std::memory_order_relaxed);
+	while (v > old_max && !max.compare_exchange_weak(old_max, v, std::memory_order_relaxed))
+	{
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+void Latency_Histogram::reset()
+{
+	for (auto& count : counts)
+	{
+		count.store(0);
+	}
+	total.store(0);
+	sum.store(0);
+	max.store(0);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Counters are read one by one without locking, so snapshot taken while pool is working
+can be slightly inconsistent(total may not match sum of counts).
+*/
+Histogram_Snapshot Latency_Histogram::snapshot() const
+{
+	Histogram_Snapshot res;
+	res.counts.resize(BUCKETS);
+	for (int i = 0; i < BUCKETS; ++i)
+	{
+		res.counts[i] = counts[i].load(std::memory_order_relaxed);
+		res.total += res.counts[i];
+	}
+	res.sum = sum.load();
+	res.max = max.load();
+	return res;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+p - from 0 to 100
+*/
+uint64_t Histogram_Snapshot::percentile(double p) const
+{
+	if (!total)
+	{
+		return 0;
+	}
+	uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p / 100.0 * total + 0.5));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < counts.size(); ++i)
+	{
+		seen += counts[i];
+		if (seen >= rank)
+		{
+			return std::min(Latency_Histogram::bucket_upper_bound(i), max);
+		}
+	}
+	return max;
+}
+
+/*-------------------------------------------POOL--------------------------------------------------------*/
+
+/*
+Share of workers time spent on tasks
+*/
+double Pool_Metrics::utilization() const
+{
+	double busy = 0;
+	double all = 0;
+	for (const auto& worker : workers)
+	{
+		busy += worker.busy_seconds;
+		all += worker.busy_seconds + worker.idle_seconds;
+	}
+	return all > 0 ? busy / all : 0;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+static void print_histogram(std::ostream& os, const char* name, const Histogram_Snapshot& h)
+{
+	os << name << ": count " << h.total << ", mean " << h.mean() / 1000 << " us, p50 " << h.percentile(50) / 1000.0
+		<< " us, p90 " << h.percentile(90) / 1000.0 << " us, p99 " << h.percentile(99) / 1000.0
+		<< " us, max " << h.max / 1000.0 << " us\n";
+}
+
+void print_metrics(std::ostream& os, const Pool_Metrics& metrics)
+{
+	os << "Tasks submitted: " << metrics.submitted_tasks << ", done by waiting threads: " << metrics.helped_tasks << "\n";
+	os << "Queue depth: " << metrics.queue_depth << ", max " << metrics.max_queue_depth << "\n";
+	print_histogram(os, "Queue wait", metrics.queue_wait);
+	print_histogram(os, "Execution", metrics.execution);
+	os << "Utilization: " << metrics.utilization() * 100 << "%\n";
+	for (size_t i = 0; i < metrics.workers.size(); ++i)
+	{
+		const Worker_Metrics& w = metrics.workers[i];
+		os << "Worker " << i << ": tasks " << w.tasks << ", busy " << w.busy_seconds * 1000 << " ms, idle "
+			<< w.idle_seconds * 1000 << " ms, parks " << w.parks << "\n";
+	}
+}
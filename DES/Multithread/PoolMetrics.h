@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <vector>
+#include <stdint.h>
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+inline int64_t metrics_now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Copy of Latency_Histogram counters, values are in nanoseconds.
+	percentile returns upper bound of the bucket that holds requested value.
+*/
+struct Histogram_Snapshot
+{
+	std::vector<uint64_t> counts;
+	uint64_t total = 0;
+	uint64_t sum = 0;
+	uint64_t max = 0;
+
+	uint64_t percentile(double p) const;
+	double mean() const { return total ? (double)sum / total : 0; }
+};
+
+/*
+	HDR-style log-linear histogram: every power of two range is split into SUB_BUCKETS linear buckets,
+	so relative error is below 1/SUB_BUCKETS for any value.
+	record is lock-free(relaxed atomics) and can be called from many threads.
+*/
+class Latency_Histogram
+{
+public:
+	static const int SUB_BUCKET_BITS = 4;
+	static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const int BUCKETS = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+	Latency_Histogram();
+	void record(int64_t value);
+	void reset();
+	Histogram_Snapshot snapshot() const;
+
+	static int bucket_of(uint64_t value);
+	static uint64_t bucket_upper_bound(int bucket);
+private:
+	std::array<std::atomic<uint64_t>, BUCKETS> counts;
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Worker counters.
+	Idle time is time between tasks(including time worker is parked on empty queue),
+	parks - how many times worker found queue empty and went to sleep.
+*/
+struct Worker_Metrics
+{
+	uint64_t tasks = 0;
+	double busy_seconds = 0;
+	double idle_seconds = 0;
+	uint64_t parks = 0;
+};
+
+/*
+	Snapshot of ThreadPoolMy telemetry(see ThreadPoolMy::metrics).
+	queue_wait - enqueue-to-start time of tasks, execution - time of tasks themselves.
+	Pool has one shared queue and no work stealing, nearest analogue is helped_tasks -
+	tasks done by threads waiting in wait_all_tasks/wait_group instead of workers.
+*/
+struct Pool_Metrics
+{
+	Histogram_Snapshot queue_wait;
+	Histogram_Snapshot execution;
+	std::vector<Worker_Metrics> workers;
+	int queue_depth = 0;
+	int max_queue_depth = 0;
+	uint64_t submitted_tasks = 0;
+	uint64_t helped_tasks = 0;
+
+	double utilization() const;
+};
+
+void print_metrics(std::ostream& os, const Pool_Metrics& metrics);
@@ -3,7 +3,11 @@
 #include <vector>
 #include <atomic>
 #include <future>
+#include <type_traits>
 #include "ThreadsafeQueue.h"
+#include "Topology.h"
+#include "PoolMetrics.h"
+#include "../DESBufferPool.h"
 
 /*-----------------------------------------------------------------------------*/
 
@@ -49,6 +53,15 @@ public:
 	function_wrapper& operator=(const function_wrapper&) = delete;
 };
 
+/*
+Task in working queue with time it was pushed(for queue wait histogram)
+*/
+struct queued_task
+{
+	function_wrapper task;
+	int64_t enqueued_ns;
+};
+
 /*-----------------------------------------------------------------------------*/
 
 
@@ -56,6 +69,51 @@ class ThreadPoolMy;
 
 /*-------------------------------------------------------------------------------------------------------*/
 
+/*
+	Group of tasks that can be waited for separately from other tasks of the pool.
+	Pass it to wait_do_task and then wait for it with ThreadPoolMy::wait_group.
+	Group must outlive all its tasks.
+*/
+class task_group
+{
+public:
+	task_group() : pending{ 0 } {}
+	task_group(const task_group&) = delete;
+	task_group& operator=(const task_group&) = delete;
+	inline int tasks_left() const { return pending; }
+private:
+	friend class ThreadPoolMy;
+	friend class task_group_slot;
+	std::atomic<int> pending;
+};
+
+/*
+	Pending task of group, kept by task in queue.
+	Released by task after it is done or on destruction if task is dropped without being done(pool shutdown),
+	so group never waits for tasks that won't run.
+*/
+class task_group_slot
+{
+public:
+	explicit task_group_slot(task_group* group_) : group{ group_ } { ++group->pending; }
+	task_group_slot(task_group_slot&& other) : group{ other.group } { other.group = nullptr; }
+	task_group_slot(const task_group_slot&) = delete;
+	task_group_slot& operator=(const task_group_slot&) = delete;
+	~task_group_slot() { release(); }
+	void release()
+	{
+		if (group)
+		{
+			--group->pending;
+			group = nullptr;
+		}
+	}
+private:
+	task_group* group;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
 /*
 	Worker.
 	Contents thread that takes tasks from thread pool(parent) and does them.
@@ -69,9 +127,16 @@ public:
 	void run();
 	ThreadPoolMy* pool() const { return parent_; }
 	inline bool free() const { return free_; }
+	Worker_Metrics metrics() const;
 private:
 	ThreadPoolMy* parent_;
 	std::atomic<bool> free_;
+	// telemetry
+	std::atomic<uint64_t> tasks_done;
+	std::atomic<uint64_t> parks;
+	std::atomic<int64_t> busy_ns;
+	std::atomic<int64_t> idle_ns;
+	std::atomic<int64_t> idle_since_ns;
 };
 
 /*-------------------------------------------------------------------------------------------------------*/
@@ -84,6 +149,13 @@ private:
 	If you want to terminate all tasks before exit, use
 	method wait_all_tasks().
 	wait_do_task and try_do_task can return values with futures.
+	Tasks can be collected in task_group and waited with wait_group.
+	Waiting thread does not sleep - it takes pending tasks from the queue and does them itself,
+	so tasks can submit and wait their own subtasks(nested parallelism) without deadlocks.
+	Process-wide pool, that is created on first use and lives until exit, is available with shared().
+	Workers can be pinned to CPUs: worker i runs on cpus[i % cpus.size()].
+	Pool collects telemetry(queue depth, queue wait and execution histograms, workers utilization),
+	use metrics() to get its snapshot.
 */
 class ThreadPoolMy
 {
@@ -91,56 +163,92 @@ public:
 	typedef int size_type;
 	typedef std::vector<std::shared_ptr<Worker>> pWorkers;
 	typedef std::vector<std::thread> Threads;
-	ThreadPoolMy(size_type n = std::thread::hardware_concurrency());
+	ThreadPoolMy(size_type n = default_concurrency());
+	ThreadPoolMy(size_type n, const std::vector<int>& cpus);
 	~ThreadPoolMy();
+	static ThreadPoolMy& shared();
+	// whether shared() was called, for reports that must not start the pool
+	static bool shared_created();
 	inline size_type size() const { return _size; }
 	inline int free_workers() const { return _size - busy_workers_count; }
 	bool has_tasks() { return !working_queue.empty(); }
 	inline bool is_terminated() const { return terminated_; }
 	template<typename F>
-	bool try_do_task(F f, std::future<typename std::result_of<F()>::type>& fut);
+	bool try_do_task(F f, std::future<std::invoke_result_t<F>>& fut);
 	template<typename F>
 	bool try_do_task(F f);
 	template<typename F>
-	std::future<typename std::result_of<F()>::type> wait_do_task(F f);
+	std::future<std::invoke_result_t<F>> wait_do_task(F f);
+	template<typename F>
+	std::future<std::invoke_result_t<F>> wait_do_task(F f, task_group& group);
 	void wait_all_tasks();
+	void wait_group(task_group& group);
+	bool run_pending_task();
 	inline int tasks_left() const { return not_done_tasks; }
+	Pool_Metrics metrics() const;
 private:
 	friend class Worker;
+	void start_workers(const std::vector<int>& cpus);
+	void push_task(function_wrapper task);
+	void run_task(queued_task& next);
 	void join_threads();
 	void terminate_all();
 	Threads threads;
 	pWorkers workers;
 	std::atomic<size_type> _size;
-	bool terminated_;
+	std::atomic<bool> terminated_;
 	// function_wrapper is used as abstract class for returning values
-	threadsafe_queue_fg<function_wrapper> working_queue;
+	threadsafe_queue_fg<queued_task> working_queue;
 	std::atomic<int> not_done_tasks;
 	std::atomic<int> busy_workers_count;
 	// mutex for blocking tasks addition in queue
 	std::mutex add_mtx;
+	// telemetry
+	Latency_Histogram queue_wait_histogram;
+	Latency_Histogram execution_histogram;
+	std::atomic<int> queued_tasks{ 0 };
+	std::atomic<int> max_queued_tasks{ 0 };
+	std::atomic<uint64_t> submitted_tasks{ 0 };
+	std::atomic<uint64_t> helped_tasks{ 0 };
 };
 
 /*-------------------------------------------------------------------------------------------------------*/
 
+/*
+Pushes task into working queue with current time and updates queue depth.
+Must be called under add_mtx.
+*/
+inline void ThreadPoolMy::push_task(function_wrapper task)
+{
+	int depth = ++queued_tasks;
+	int old_max = max_queued_tasks.load(std::memory_order_relaxed);
+	while (depth > old_max && !max_queued_tasks.compare_exchange_weak(old_max, depth))
+	{
+	}
+	++submitted_tasks;
+	working_queue.push(queued_task{ std::move(task), metrics_now_ns() });
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
 /*
 Tries to push task into working queue.
 Returns success flag(true - task was pushed into queue, false - wasn't).
 Result will be written into future passed by reference.
 */
 template<typename F>
-bool ThreadPoolMy::try_do_task(F f, std::future<typename std::result_of<F()>::type>& fut)
+bool ThreadPoolMy::try_do_task(F f, std::future<std::invoke_result_t<F>>& fut)
 {
 	if (busy_workers_count.load() == _size)
 	{
 		return false;
 	}
-	typedef typename std::result_of<F()>::type result_type;
+	typedef std::invoke_result_t<F> result_type;
 	std::packaged_task<result_type()> task(std::move(f));
 	fut = task.get_future();
 	std::lock_guard<std::mutex> lck{ add_mtx };
-	// using move because function wrapper only accepts references on rvalues
-	working_queue.push(std::move(f));
+	// packaged task is pushed(f is moved-from already), using move because function wrapper only accepts references on rvalues
+	push_task(std::move(task));
 	++not_done_tasks;
 	return true;
 }
@@ -157,11 +265,11 @@ bool ThreadPoolMy::try_do_task(F f)
 	{
 		return false;
 	}
-	typedef typename std::result_of<F()>::type result_type;
+	typedef std::invoke_result_t<F> result_type;
 	std::packaged_task<result_type()> task(std::move(f));
 	std::lock_guard<std::mutex> lck{ add_mtx };
 	//   move ,  function_wrapper    rvalue
-	working_queue.push(std::move(f));
+	push_task(std::move(task));
 	++not_done_tasks;
 	return true;
 }
@@ -173,15 +281,57 @@ Waits for free worker and pushes task in working queue.
 Returns future by which you can retrieve returned value later.
 */
 template<typename F>
-std::future<typename std::result_of<F()>::type> ThreadPoolMy::wait_do_task(F f)
+std::future<std::invoke_result_t<F>> ThreadPoolMy::wait_do_task(F f)
 {
-	typedef typename std::result_of<F()>::type result_type;
+	typedef std::invoke_result_t<F> result_type;
 	std::packaged_task<result_type()> task(std::move(f));
 	std::future<result_type> res(task.get_future());
 	std::lock_guard<std::mutex> lck{ add_mtx };
-	working_queue.push(std::move(task));
+	push_task(std::move(task));
 	++not_done_tasks;
 	return res;
 }
 
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Same as wait_do_task, but also adds task to the group.
+Use wait_group to wait for all tasks of the group.
+*/
+template<typename F>
+std::future<std::invoke_result_t<F>> ThreadPoolMy::wait_do_task(F f, task_group& group)
+{
+	typedef std::invoke_result_t<F> result_type;
+	std::packaged_task<result_type()> task(std::move(f));
+	std::future<result_type> res(task.get_future());
+	task_group_slot slot(&group);
+	std::lock_guard<std::mutex> lck{ add_mtx };
+	// group counter is decremented only after future becomes ready
+	push_task([task = std::move(task), slot = std::move(slot)]() mutable { task(); slot.release(); });
+	++not_done_tasks;
+	return res;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Worker groups for NUMA machines: one ThreadPoolMy per node with workers pinned to CPUs of that node.
+	Memory used by tasks of pool(node) should be allocated and first touched by that pool's workers,
+	so it lives on the same node(see File_Crypter::run_mt_numa).
+	Every node has its own Buffer_Pool of fresh pages: its buffers are taken only by that node,
+	so pages first touched by node's workers are never given to other nodes(as buffers of shared pool could be).
+*/
+class Node_Pools
+{
+public:
+	Node_Pools(const Cpu_Topology& topology = Cpu_Topology::detect(), int threads_per_node = 0);
+	inline int nodes() const { return pools.size(); }
+	inline ThreadPoolMy& pool(int node) { return *pools[node]; }
+	inline Buffer_Pool& buffer_pool(int node) { return *buffer_pools[node]; }
+private:
+	// destroyed after pools, so workers don't hold their buffers
+	std::vector<std::unique_ptr<Buffer_Pool>> buffer_pools;
+	std::vector<std::unique_ptr<ThreadPoolMy>> pools;
+};
+
 /*-------------------------------------------------------------------------------------------------------*/
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <iostream>
+#include <iterator>
 
 /*-------------------------------------------------------------------------------------------------------------*/
 
@@ -78,6 +79,228 @@ public:
 		std::lock_guard<std::mutex> lk(mut);
 		return data_queue.empty();
 	}
+	/*
+		Pushes all values of range with one lock and one wakeup.
+		Values are moved from range.
+	*/
+	template<typename Range>
+	void push_bulk(Range&& values)
+	{
+		size_t pushed = 0;
+		{
+			std::lock_guard<std::mutex> lk(mut);
+			for (auto& value : values)
+			{
+				data_queue.push(std::move(value));
+				++pushed;
+			}
+		}
+		if (pushed == 1)
+		{
+			data_cond.notify_one();
+		}
+		else if (pushed > 1)
+		{
+			data_cond.notify_all();
+		}
+	}
+	/*
+		Pops up to max values into out iterator with one lock.
+		Returns number of popped values(0 if queue is empty).
+	*/
+	template<typename OutputIt>
+	size_t try_pop_bulk(OutputIt out, size_t max)
+	{
+		std::lock_guard<std::mutex> lk(mut);
+		return pop_bulk(out, max);
+	}
+	/*
+		Waits for at least one value, then pops up to max values into out iterator.
+	*/
+	template<typename OutputIt>
+	size_t wait_and_pop_bulk(OutputIt out, size_t max)
+	{
+		std::unique_lock<std::mutex> lk(mut);
+		data_cond.wait(lk, [this] {return !data_queue.empty(); });
+		return pop_bulk(out, max);
+	}
+private:
+	// mut must be locked
+	template<typename OutputIt>
+	size_t pop_bulk(OutputIt& out, size_t max)
+	{
+		size_t popped = 0;
+		while (popped < max && !data_queue.empty())
+		{
+			*out++ = std::move(data_queue.front());
+			data_queue.pop();
+			++popped;
+		}
+		return popped;
+	}
+};
+
+/*-------------------------------------------------------------------------------------------------------------*/
+
+/*
+	Threadsafe queue with limited capacity.
+	Producers are blocked while queue is full(backpressure), try_push fails instead.
+*/
+template<typename T>
+class threadsafe_bounded_queue
+{
+private:
+	mutable std::mutex mut;
+	std::queue<T> data_queue;
+	std::condition_variable data_cond;		// signaled when value is pushed
+	std::condition_variable space_cond;		// signaled when value is popped
+	const size_t capacity_;
+
+	// mut must be locked
+	template<typename OutputIt>
+	size_t pop_bulk(OutputIt& out, size_t max)
+	{
+		size_t popped = 0;
+		while (popped < max && !data_queue.empty())
+		{
+			*out++ = std::move(data_queue.front());
+			data_queue.pop();
+			++popped;
+		}
+		return popped;
+	}
+
+	void notify_space(size_t popped)
+	{
+		if (popped == 1)
+		{
+			space_cond.notify_one();
+		}
+		else if (popped > 1)
+		{
+			space_cond.notify_all();
+		}
+	}
+public:
+	explicit threadsafe_bounded_queue(size_t capacity)
+		: capacity_{ capacity > 0 ? capacity : 1 }
+	{}
+	threadsafe_bounded_queue(const threadsafe_bounded_queue&) = delete;
+	threadsafe_bounded_queue& operator=(const threadsafe_bounded_queue&) = delete;
+
+	inline size_t capacity() const { return capacity_; }
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lk(mut);
+		return data_queue.size();
+	}
+	bool empty() const
+	{
+		std::lock_guard<std::mutex> lk(mut);
+		return data_queue.empty();
+	}
+	/*
+		waits for free space in queue, then pushes
+	*/
+	void push(T new_value)
+	{
+		std::unique_lock<std::mutex> lk(mut);
+		space_cond.wait(lk, [this] {return data_queue.size() < capacity_; });
+		data_queue.push(std::move(new_value));
+		lk.unlock();
+		data_cond.notify_one();
+	}
+	/*
+		returns false if queue is full
+	*/
+	bool try_push(T new_value)
+	{
+		{
+			std::lock_guard<std::mutex> lk(mut);
+			if (data_queue.size() >= capacity_)
+			{
+				return false;
+			}
+			data_queue.push(std::move(new_value));
+		}
+		data_cond.notify_one();
+		return true;
+	}
+	/*
+		Pushes all values of range(values are moved), taking lock once per portion of free space
+		and blocking while queue is full.
+	*/
+	template<typename Range>
+	void push_bulk(Range&& values)
+	{
+		auto it = std::begin(values);
+		auto end = std::end(values);
+		while (it != end)
+		{
+			size_t pushed = 0;
+			{
+				std::unique_lock<std::mutex> lk(mut);
+				space_cond.wait(lk, [this] {return data_queue.size() < capacity_; });
+				for (; it != end && data_queue.size() < capacity_; ++it)
+				{
+					data_queue.push(std::move(*it));
+					++pushed;
+				}
+			}
+			if (pushed == 1)
+			{
+				data_cond.notify_one();
+			}
+			else
+			{
+				data_cond.notify_all();
+			}
+		}
+	}
+	void wait_and_pop(T& value)
+	{
+		std::unique_lock<std::mutex> lk(mut);
+		data_cond.wait(lk, [this] {return !data_queue.empty(); });
+		value = std::move(data_queue.front());
+		data_queue.pop();
+		lk.unlock();
+		space_cond.notify_one();
+	}
+	bool try_pop(T& value)
+	{
+		{
+			std::lock_guard<std::mutex> lk(mut);
+			if (data_queue.empty())
+				return false;
+			value = std::move(data_queue.front());
+			data_queue.pop();
+		}
+		space_cond.notify_one();
+		return true;
+	}
+	template<typename OutputIt>
+	size_t try_pop_bulk(OutputIt out, size_t max)
+	{
+		size_t popped = 0;
+		{
+			std::lock_guard<std::mutex> lk(mut);
+			popped = pop_bulk(out, max);
+		}
+		notify_space(popped);
+		return popped;
+	}
+	template<typename OutputIt>
+	size_t wait_and_pop_bulk(OutputIt out, size_t max)
+	{
+		size_t popped = 0;
+		{
+			std::unique_lock<std::mutex> lk(mut);
+			data_cond.wait(lk, [this] {return !data_queue.empty(); });
+			popped = pop_bulk(out, max);
+		}
+		notify_space(popped);
+		return popped;
+	}
 };
 
 /*-------------------------------------------------------------------------------------------------------------*/
@@ -108,6 +331,7 @@ private:
 	std::mutex tail_mutex;
 	node* tail;
 	std::condition_variable data_cond;		// used in waip_and_pop
+	bool closed;							// guarded by head_mutex
 
 	/*
 		safe tail getter
@@ -150,10 +374,47 @@ private:
 		return old_head;
 	}
 
+	/*
+		safe head getter with waiting, that also wakes up on closing of queue
+		returns empty pointer if queue was closed
+	*/
+	std::unique_ptr<node> pop_head_wait_or_closed()
+	{
+		std::unique_lock<std::mutex> lk(head_mutex);
+		data_cond.wait(lk, [&] { return closed || head.get() != get_tail(); });
+		if (closed)
+		{
+			return std::unique_ptr<node>();
+		}
+
+		std::unique_ptr<node> old_head = std::move(head);
+		head = std::move(old_head->next);
+		return old_head;
+	}
+
+	/*
+		moves up to max values from head nodes into out iterator
+		head_mutex must be locked, tail is taken only once
+	*/
+	template<typename OutputIt>
+	size_t pop_head_bulk(OutputIt& out, size_t max)
+	{
+		node* const current_tail = get_tail();
+		size_t popped = 0;
+		while (popped < max && head.get() != current_tail)
+		{
+			std::unique_ptr<node> old_head = std::move(head);
+			head = std::move(old_head->next);
+			*out++ = std::move(*old_head->data);
+			++popped;
+		}
+		return popped;
+	}
+
 public:
 	// on creation list is empty and tail and head are the same
 	threadsafe_queue_fg() :
-		head(new node), tail(head.get())
+		head(new node), tail(head.get()), closed(false)
 	{}
 	// forbidding copying
 	threadsafe_queue_fg(const threadsafe_queue_fg<T>& other) = delete;
@@ -163,9 +424,17 @@ public:
 	bool try_pop(T& value);
 	std::shared_ptr<T> wait_and_pop();
 	void wait_and_pop(T& value);
+	bool wait_and_pop_unless_closed(T& value);
 	void push(T new_value);
+	template<typename Range>
+	void push_bulk(Range&& values);
+	template<typename OutputIt>
+	size_t try_pop_bulk(OutputIt out, size_t max);
+	template<typename OutputIt>
+	size_t wait_and_pop_bulk(OutputIt out, size_t max);
 	void clear();
 	bool empty();
+	void close();
 };
 
 /*-------------------------------------------------------------------------------------------------------------*/
@@ -188,6 +457,79 @@ void threadsafe_queue_fg<T>::push(T new_value)
 
 /*-------------------------------------------------------------------------------------------------------------*/
 
+/*
+	Pushes all values of range(values are moved).
+	Nodes are linked in a chain before locking, so tail is locked once for O(1) time,
+	and waiting threads are woken up once.
+*/
+template<typename T>
+template<typename Range>
+void threadsafe_queue_fg<T>::push_bulk(Range&& values)
+{
+	auto it = std::begin(values);
+	auto end = std::end(values);
+	if (it == end)
+	{
+		return;
+	}
+	// first value goes into current dummy tail, others - into new nodes, last new node is new dummy
+	std::shared_ptr<T> first_data(std::make_shared<T>(std::move(*it++)));
+	std::unique_ptr<node> chain(new node);
+	node* chain_tail = chain.get();
+	size_t pushed = 1;
+	for (; it != end; ++it)
+	{
+		chain_tail->data = std::make_shared<T>(std::move(*it));
+		chain_tail->next.reset(new node);
+		chain_tail = chain_tail->next.get();
+		++pushed;
+	}
+	{
+		std::lock_guard<std::mutex> tail_lock(tail_mutex);
+		tail->data = first_data;
+		tail->next = std::move(chain);
+		tail = chain_tail;
+	}
+	if (pushed == 1)
+	{
+		data_cond.notify_one();
+	}
+	else
+	{
+		data_cond.notify_all();
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------------*/
+
+/*
+	Pops up to max values into out iterator with one lock.
+	Returns number of popped values(0 if queue is empty).
+*/
+template<typename T>
+template<typename OutputIt>
+size_t threadsafe_queue_fg<T>::try_pop_bulk(OutputIt out, size_t max)
+{
+	std::lock_guard<std::mutex> head_lock(head_mutex);
+	return pop_head_bulk(out, max);
+}
+
+/*-------------------------------------------------------------------------------------------------------------*/
+
+/*
+	Waits for at least one value, then pops up to max values into out iterator.
+*/
+template<typename T>
+template<typename OutputIt>
+size_t threadsafe_queue_fg<T>::wait_and_pop_bulk(OutputIt out, size_t max)
+{
+	std::unique_lock<std::mutex> lk(head_mutex);
+	data_cond.wait(lk, [&] { return head.get() != get_tail(); });
+	return pop_head_bulk(out, max);
+}
+
+/*-------------------------------------------------------------------------------------------------------------*/
+
 /*
 	On fail return empty shared_ptr, on success - shared_ptr with data
 */
@@ -235,6 +577,40 @@ void threadsafe_queue_fg<T>::wait_and_pop(T& val)
 
 /*-------------------------------------------------------------------------------------------------------------*/
 
+/*
+	Waits and pops.
+	Returns false without popping if queue was closed(even if it still has data).
+*/
+template<typename T>
+bool threadsafe_queue_fg<T>::wait_and_pop_unless_closed(T& val)
+{
+	std::unique_ptr<node> old_head = pop_head_wait_or_closed();
+	if (!old_head)
+	{
+		return false;
+	}
+	val = std::move(*(old_head.get()->data.get()));
+	return true;
+}
+
+/*-------------------------------------------------------------------------------------------------------------*/
+
+/*
+	Wakes up all threads waiting in wait_and_pop_unless_closed, they will return false.
+	Data stays in queue, owner should take it with try_pop(ThreadPoolMy drops tasks that are left).
+*/
+template<typename T>
+void threadsafe_queue_fg<T>::close()
+{
+	{
+		std::lock_guard<std::mutex> head_lock(head_mutex);
+		closed = true;
+	}
+	data_cond.notify_all();
+}
+
+/*-------------------------------------------------------------------------------------------------------------*/
+
 template<typename T>
 bool threadsafe_queue_fg<T>::empty()
 {
@@ -0,0 +1,332 @@
+#include "stdafx.h"
+#include "Topology.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Parses linux cpu list format: "0-3,8,10-11" (also used for nodes lists).
+Returns empty vector on error.
+*/
+std::vector<int> parse_cpu_list(const std::string& list)
+{
+	std::vector<int> res;
+	std::stringstream ss(list);
+	std::string range;
+	while (std::getline(ss, range, ','))
+	{
+		range.erase(std::remove_if(range.begin(), range.end(), [](char c) { return isspace((unsigned char)c); }), range.end());
+		if (range.empty())
+		{
+			continue;
+		}
+		size_t dash = range.find('-');
+		try
+		{
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			if (first < 0 || last < first)
+			{
+				return std::vector<int>();
+			}
+			for (int cpu = first; cpu <= last; ++cpu)
+			{
+				res.push_back(cpu);
+			}
+		}
+		catch (std::exception&)
+		{
+			return std::vector<int>();
+		}
+	}
+	return res;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Pins thread to cpu.
+Returns false if it is not possible(or not supported on this platform).
+*/
+bool pin_thread(std::thread& thread, int cpu)
+{
+#ifdef __linux__
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+	{
+		return false;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+#ifdef __linux__
+static std::string read_first_line(const std::string& fname)
+{
+	std::ifstream ifs(fname);
+	std::string line;
+	std::getline(ifs, line);
+	return line;
+}
+#endif
+
+/*
+CPUs allowed by cgroup quota: quota / period rounded up.
+Returns 0 if there is no limit(quota <= 0).
+*/
+int cpus_from_cgroup_quota(long long quota, long long period)
+{
+	if (quota <= 0 || period <= 0)
+	{
+		return 0;
+	}
+	return (int)((quota + period - 1) / period);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+CPUs allowed by cgroup v2 cpu.max line("max 100000" or "400000 100000").
+Returns 0 if there is no limit.
+*/
+int cpus_from_cgroup_cpu_max(const std::string& cpu_max)
+{
+	std::stringstream ss(cpu_max);
+	std::string quota;
+	long long period = 0;
+	if (!(ss >> quota >> period) || quota == "max")
+	{
+		return 0;
+	}
+	try
+	{
+		return cpus_from_cgroup_quota(std::stoll(quota), period);
+	}
+	catch (std::exception&)
+	{
+		return 0;
+	}
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+#ifdef __linux__
+/*
+CPUs allowed by cgroup(v2 or v1) of the process, 0 if there is no limit.
+Cgroup directory of the process is taken from /proc/self/cgroup, inside of containers it is usually root.
+*/
+static int cgroup_cpu_limit()
+{
+	std::string v2_path = "/";
+	std::string v1_path = "/";
+	std::ifstream cgroups("/proc/self/cgroup");
+	std::string line;
+	while (std::getline(cgroups, line))
+	{
+		// hierarchy-ID:controller-list:cgroup-path
+		size_t first = line.find(':');
+		size_t second = line.find(':', first + 1);
+		if (first == std::string::npos || second == std::string::npos)
+		{
+			continue;
+		}
+		std::string controllers = line.substr(first + 1, second - first - 1);
+		if (controllers.empty())
+		{
+			v2_path = line.substr(second + 1);
+		}
+		else if (("," + controllers + ",").find(",cpu,") != std::string::npos)
+		{
+			v1_path = line.substr(second + 1);
+		}
+	}
+	for (const std::string& dir : { "/sys/fs/cgroup" + v2_path, std::string("/sys/fs/cgroup") })
+	{
+		std::ifstream cpu_max(dir + "/cpu.max");
+		if (cpu_max)
+		{
+			std::getline(cpu_max, line);
+			return cpus_from_cgroup_cpu_max(line);
+		}
+	}
+	for (const std::string& dir : { "/sys/fs/cgroup/cpu" + v1_path, std::string("/sys/fs/cgroup/cpu"), std::string("/sys/fs/cgroup/cpu,cpuacct") })
+	{
+		std::ifstream quota_file(dir + "/cpu.cfs_quota_us");
+		std::ifstream period_file(dir + "/cpu.cfs_period_us");
+		long long quota = 0;
+		long long period = 0;
+		if (quota_file >> quota && period_file >> period)
+		{
+			return cpus_from_cgroup_quota(quota, period);
+		}
+	}
+	return 0;
+}
+#endif
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Number of threads the process can really use in parallel:
+CPUs of affinity mask(cpuset), limited by cgroup CPU quota.
+Falls back to std::thread::hardware_concurrency(), always at least 1.
+*/
+int default_concurrency()
+{
+	int cpus = std::thread::hardware_concurrency();
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+	{
+		cpus = CPU_COUNT(&allowed);
+	}
+	int quota_cpus = cgroup_cpu_limit();
+	if (quota_cpus > 0 && quota_cpus < cpus)
+	{
+		cpus = quota_cpus;
+	}
+#endif
+	return std::max(1, cpus);
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+Cpu_Topology Cpu_Topology::detect()
+{
+	Cpu_Topology topology;
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool has_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+	std::vector<int> node_ids = parse_cpu_list(read_first_line("/sys/devices/system/node/online"));
+	for (int node : node_ids)
+	{
+		std::vector<int> cpus = parse_cpu_list(read_first_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+		if (has_mask)
+		{
+			cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu) { return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed); }), cpus.end());
+		}
+		if (!cpus.empty())
+		{
+			topology.nodes.push_back(cpus);
+		}
+	}
+	if (topology.nodes.empty() && has_mask)
+	{
+		std::vector<int> cpus;
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (CPU_ISSET(cpu, &allowed))
+			{
+				cpus.push_back(cpu);
+			}
+		}
+		topology.nodes.push_back(cpus);
+	}
+#endif
+	if (topology.nodes.empty())
+	{
+		std::vector<int> cpus;
+		for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+		{
+			cpus.push_back(cpu);
+		}
+		topology.nodes.push_back(cpus);
+	}
+	return topology;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+int Cpu_Topology::cpus_count() const
+{
+	int count = 0;
+	for (const auto& node : nodes)
+	{
+		count += node.size();
+	}
+	return count;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Returns false on incorrect string
+*/
+bool Thread_Placement::parse(const std::string& str, Thread_Placement& placement)
+{
+	placement = Thread_Placement{};
+	if (str == "compact")
+	{
+		placement.policy = Compact;
+	}
+	else if (str == "scatter")
+	{
+		placement.policy = Scatter;
+	}
+	else
+	{
+		placement.cpus = parse_cpu_list(str);
+		if (placement.cpus.empty())
+		{
+			return false;
+		}
+		placement.policy = Cpuset;
+	}
+	return true;
+}
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Returns cpu for every of 'threads' workers(or empty vector for None policy).
+If there are more workers than cpus, cpus are reused in the same order.
+*/
+std::vector<int> Thread_Placement::cpus_for(int threads, const Cpu_Topology& topology) const
+{
+	std::vector<int> order;
+	if (policy == Cpuset)
+	{
+		order = cpus;
+	}
+	else if (policy == Compact)
+	{
+		for (const auto& node : topology.nodes)
+		{
+			order.insert(order.end(), node.begin(), node.end());
+		}
+	}
+	else if (policy == Scatter)
+	{
+		for (size_t i = 0; order.size() < (size_t)topology.cpus_count(); ++i)
+		{
+			for (const auto& node : topology.nodes)
+			{
+				if (i < node.size())
+				{
+					order.push_back(node[i]);
+				}
+			}
+		}
+	}
+	std::vector<int> res;
+	for (int i = 0; i < threads && !order.empty(); ++i)
+	{
+		res.push_back(order[i % order.size()]);
+	}
+	return res;
+}
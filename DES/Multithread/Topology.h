@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	CPU topology: NUMA nodes with lists of their CPUs.
+	On Linux it is read from /sys/devices/system/node and limited to CPUs the process is allowed to run on.
+	If there is no such information(or not Linux), all CPUs are considered to be in one node.
+*/
+struct Cpu_Topology
+{
+	std::vector<std::vector<int>> nodes;
+
+	static Cpu_Topology detect();
+	int cpus_count() const;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+	Workers pinning policy.
+		None - workers are not pinned,
+		Compact - workers fill CPUs of one node before going to the next one,
+		Scatter - workers are distributed round-robin between nodes,
+		Cpuset - workers are pinned to CPUs from the list, in order.
+	Parsed from "compact", "scatter" or cpu list like "0-3,8,10-11".
+*/
+struct Thread_Placement
+{
+	enum Policy { None, Compact, Scatter, Cpuset };
+	Policy policy = None;
+	std::vector<int> cpus;
+
+	static bool parse(const std::string& str, Thread_Placement& placement);
+	std::vector<int> cpus_for(int threads, const Cpu_Topology& topology) const;
+};
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+std::vector<int> parse_cpu_list(const std::string& list);
+bool pin_thread(std::thread& thread, int cpu);
+int default_concurrency();
+int cpus_from_cgroup_quota(long long quota, long long period);
+int cpus_from_cgroup_cpu_max(const std::string& cpu_max);
@@ -3,21 +3,258 @@
 
 #include "stdafx.h"
 
+#include <algorithm>
 #include <ctime>
+#include <chrono>
 #include <string>
 #include <fstream>
+#include <filesystem>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "DESAutotune.h"
+#include "DESBatch.h"
+#include "DESDaemon.h"
 #include "DESFileCrypt.h"
+#include "DESIncremental.h"
+#include "DESShard.h"
+#include "DESTrace.h"
 
 
+/*
+Measurements of one run for --stats and --stats-json
+*/
+struct Cli_Stats
+{
+	double wall_seconds;
+	double cpu_seconds;
+	uint64_t cycles;
+	Run_Stats run;
+};
+
+static double mb_per_second(const Cli_Stats& st)
+{
+	return st.wall_seconds > 0 ? st.run.bytes / (1024.0 * 1024.0) / st.wall_seconds : 0;
+}
+
+static double cycles_per_byte(const Cli_Stats& st)
+{
+	return st.run.bytes ? (double)st.cycles / st.run.bytes : 0;
+}
+
+void print_stats(const Cli_Stats& st)
+{
+	std::cout << "Bytes: " << st.run.bytes << "\n";
+	std::cout << "Wall time: " << st.wall_seconds * 1000 << " ms\n";
+	std::cout << "CPU time: " << st.cpu_seconds * 1000 << " ms\n";
+	std::cout << "Throughput: " << mb_per_second(st) << " MB/s\n";
+	std::cout << "Cycles/byte: " << cycles_per_byte(st) << "\n";
+	std::cout << "Read: " << st.run.read_seconds * 1000 << " ms, compute: " << st.run.compute_seconds * 1000
+		<< " ms, write: " << st.run.write_seconds * 1000 << " ms\n";
+}
+
+/*
+Returns false if file could not be written
+*/
+bool write_stats_json(const Cli_Stats& st, const std::string& fname)
+{
+	std::ofstream ofs(fname);
+	ofs << "{\"bytes\": " << st.run.bytes
+		<< ", \"wall_seconds\": " << st.wall_seconds
+		<< ", \"cpu_seconds\": " << st.cpu_seconds
+		<< ", \"mb_per_second\": " << mb_per_second(st)
+		<< ", \"cycles_per_byte\": " << cycles_per_byte(st)
+		<< ", \"read_seconds\": " << st.run.read_seconds
+		<< ", \"compute_seconds\": " << st.run.compute_seconds
+		<< ", \"write_seconds\": " << st.run.write_seconds << "}\n";
+	return (bool)ofs;
+}
+
+/*
+Prints checksums of the last run and saves them next to output file(output_file.sum)
+*/
+void print_checksums(const File_Crypter& crypter)
+{
+	std::cout << "Checksum(" << checksum_name(crypter.checksum) << ") of input: " << std::hex << crypter.input_checksum.value()
+		<< ", of output: " << crypter.output_checksum.value() << std::dec << "\n";
+	if (crypter.ofname != "-" && !save_checksums(crypter.ofname + ".sum", crypter.input_checksum, crypter.output_checksum))
+	{
+		std::cout << "Warning! Could not write checksums into " << crypter.ofname << ".sum.\n";
+	}
+}
 
 void print_usage()
 {
-	std::cout << "Usage: DES mode [settings] keys_file input_file output_file\nModes: -e - encrypt, -d - decrypt\n";
+	std::cout << "Usage: DES mode [settings] keys_file input_file output_file [input_file output_file ...]\nModes: -e - encrypt, -d - decrypt\n";
+	std::cout << "Input or output file - is stdin or stdout, messages go to stderr then.\n";
 	std::cout << "settings: -3 eee3 || ede3 - triple DES\n";
 	std::cout << "\t-mt - multithread mode\n";
+	std::cout << "\t-pin compact || scatter || cpu_list - multithread mode with workers pinned to CPUs\n";
+	std::cout << "\t-numa - multithread mode with worker group per NUMA node\n";
+	std::cout << "\t--stats - print wall and CPU time, MB/s, cycles/byte and read/compute/write times\n";
+	std::cout << "\t--stats-json fname - write the same statistics into fname as JSON\n";
+	std::cout << "\t--pool-metrics - print thread pool telemetry(queue depth, task latencies, workers utilization)\n";
+	std::cout << "\t--trace fname - write timeline of reads, run_des tasks, waits and writes as Chrome trace JSON(build with DES_TRACE)\n";
+	std::cout << "\t--perf - print hardware performance counters of hot regions(build with DES_PERF_COUNTERS)\n";
+	std::cout << "\t--engine reference || table - cipher engine\n";
+	std::cout << "\t--autotune - calibrate engine, threads, buffer size and I/O backend on this input, save them into profile and run\n";
+	std::cout << "\t--profile fname - profile file instead of " << default_profile_path() << "\n";
+	std::cout << "\t--manifest fname - batch of files from fname, line per file: input_file<TAB>output_file\n";
+	std::cout << "\t-r - batch of all files of input_file directory tree into the same tree in output_file directory\n";
+	std::cout << "Profile of this host is loaded at startup, explicit settings override it.\n";
+	std::cout << "Several pairs of files, --manifest or -r run as one batch with one pool and status of every file.\n";
+	std::cout << "\t--via socket - send request to daemon instead of processing in this process\n";
+	std::cout << "\t--pass-fds - with --via: open files here and pass descriptors to daemon\n";
+	std::cout << "\t--checksum crc32c || xxh64 - checksums of input and output in the same pass, saved into output_file.sum\n";
+	std::cout << "\t--incremental - process and rewrite in place only chunks changed since the last run(manifest output_file.chunks)\n";
+	std::cout << "\t--checkpoint fname - save progress into fname, interrupted run started again resumes from it\n";
+	std::cout << "\t--range start:[end] - process only bytes [start, end) of input(multiples of 8) into shard file\n";
+	std::cout << "\t--shard index/count - range of shard index(from 0) of count equal shards of input\n";
+	std::cout << "\t--shared-output - with --range or --shard: write range into the same place of output file instead of shard file\n";
 	std::cout << "Key file generation: DES -g keys_number fname\n";
+	std::cout << "Daemon: DES -daemon socket [cache_size], stop it: DES -daemon-stop socket\n";
+	std::cout << "Merging shard files: DES -merge output_file shard_file [shard_file ...]\n";
+}
+
+/*
+Runs batch of files with settings of crypter, prints status of every file and puts totals into crypter.stats.
+files - pairs of input and output files(directories if recursive).
+Returns number of failed files or -1 if list of files could not be made.
+*/
+int run_batch(File_Crypter& crypter, const std::string& manifest, bool recursive, char** files, int count)
+{
+	Batch_Crypter batch(crypter);
+	if (!manifest.empty() && batch.add_manifest(manifest) < 0)
+	{
+		std::cout << "Error! Could not read manifest " << manifest << ".\n";
+		return -1;
+	}
+	if (recursive)
+	{
+		if (batch.add_tree(files[0], files[1]) < 0)
+		{
+			std::cout << "Error! " << files[0] << " is not a directory.\n";
+			return -1;
+		}
+	}
+	else
+	{
+		for (int i = 0; i + 1 < count; i += 2)
+		{
+			Batch_Item item;
+			item.ifname = files[i];
+			item.ofname = files[i + 1];
+			batch.items.push_back(item);
+		}
+	}
+
+	// singlethread mode: pool without workers, tasks are done by calling thread while it waits for them
+	std::unique_ptr<ThreadPoolMy> inline_pool;
+	if (!crypter.multithread)
+	{
+		inline_pool.reset(new ThreadPoolMy(0));
+	}
+	batch.thread_pool = inline_pool ? inline_pool.get()
+		: (crypter.node_pools ? &crypter.node_pools->pool(0) : crypter.thread_pool);
+	int failed = batch.run();
+	for (const Batch_Item& item : batch.items)
+	{
+		if (item.failed)
+		{
+			std::cout << "FAILED " << item.ifname << ": " << item.error << "\n";
+		}
+		else
+		{
+			std::cout << "OK " << item.ifname << " -> " << item.ofname << " (" << item.bytes << " bytes)\n";
+		}
+	}
+	std::cout << batch.items.size() - failed << " of " << batch.items.size() << " files done\n";
+	crypter.stats = batch.stats;
+	return failed;
 }
 
+/*
+Serves requests on socket with pool and engine of profile of this host until -daemon-stop
+*/
+int run_daemon(const std::string& socket_path, size_t cache_size)
+{
+	Tuning_Profile profile;
+	bool tuned = load_profile(default_profile_path(), profile);
+	// requests are served by calling thread together with pool
+	ThreadPoolMy pool(tuned ? std::max(profile.threads - 1, 1) : default_concurrency());
+	DES_Daemon daemon(pool, cache_size);
+	if (tuned)
+	{
+		daemon.engine = profile.engine;
+		daemon.buffer_size = profile.buffer_size;
+	}
+	if (daemon.listen(socket_path))
+	{
+		std::cout << "Error! Could not listen on " << socket_path << ".\n";
+		return 1;
+	}
+	std::cout << "Listening on " << socket_path << ", engine " << engine_name(daemon.engine) << ", "
+		<< pool.size() + 1 << " threads" << std::endl;
+	daemon.serve();
+	std::cout << "Stopped, key cache hits: " << daemon.cache.hits() << ", misses: " << daemon.cache.misses() << "\n";
+	return 0;
+}
+
+/*
+Client mode: sends one request to daemon, paths are made absolute because daemon has other working directory
+*/
+int run_client(const std::string& socket_path, const File_Crypter& crypter, bool pass_fds)
+{
+	Daemon_Request request;
+	request.op = crypter.mode;
+	request.cipher = !crypter.triple_des ? 0 : (crypter.get_triple_des_mode() == crypter.EEE3 ? 1 : 2);
+	request.kname = std::filesystem::absolute(crypter.kname).string();
+	request.ifname = std::filesystem::absolute(crypter.ifname).string();
+	request.ofname = std::filesystem::absolute(crypter.ofname).string();
+	if (!pass_fds && (crypter.ifname == "-" || crypter.ofname == "-"))
+	{
+		std::cout << "Error! Daemon gets stdin and stdout with --pass-fds only.\n";
+		return 1;
+	}
+#ifndef _WIN32
+	if (pass_fds)
+	{
+		request.kind = Daemon_Request::Fds;
+		// stdin and stdout are passed as they are
+		request.in_fd = crypter.ifname == "-" ? dup(STDIN_FILENO) : open(crypter.ifname.c_str(), O_RDONLY);
+		request.out_fd = crypter.ofname == "-" ? dup(STDOUT_FILENO) : open(crypter.ofname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (request.in_fd < 0 || request.out_fd < 0)
+		{
+			std::cout << "Error! Incorrect file name.\n";
+			return 1;
+		}
+	}
+#endif
+	Daemon_Response response;
+	bool called = daemon_call(socket_path, request, response);
+#ifndef _WIN32
+	for (int fd : { request.in_fd, request.out_fd })
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+	}
+#endif
+	if (!called)
+	{
+		std::cout << "Error! Could not reach daemon on " << socket_path << ".\n";
+		return 1;
+	}
+	if (response.status)
+	{
+		std::cout << "Error from daemon: " << response.message << ".\n";
+		return 1;
+	}
+	std::cout << "Done(" << response.bytes << " bytes by daemon)\n";
+	return 0;
+}
 
 int main(int argc, char* argv[])
 {
@@ -25,6 +262,35 @@ int main(int argc, char* argv[])
 	File_Crypter crypter;
 
 
+	if (argc >= 3 && std::string(argv[1]) == "-daemon")
+	{
+		return run_daemon(argv[2], argc > 3 ? std::stoi(argv[3]) : 64);
+	}
+	if (argc >= 3 && std::string(argv[1]) == "-daemon-stop")
+	{
+		Daemon_Request request;
+		request.op = Daemon_Request::Shutdown;
+		Daemon_Response response;
+		if (!daemon_call(argv[2], request, response))
+		{
+			std::cout << "Error! Could not reach daemon on " << argv[2] << ".\n";
+			return 1;
+		}
+		std::cout << "Stopped.\n";
+		return 0;
+	}
+	if (argc >= 4 && std::string(argv[1]) == "-merge")
+	{
+		std::string error;
+		if (merge_shards(std::vector<std::string>(argv + 3, argv + argc), argv[2], error))
+		{
+			std::cout << "Error! Could not merge shards: " << error << ".\n";
+			return 1;
+		}
+		std::cout << "Merged " << argc - 3 << " shards.\n";
+		return 0;
+	}
+
 	if (argc < 4)
 	{
 		std::cout << "Error! Incorrect arguments count.\n";
@@ -72,75 +338,326 @@ int main(int argc, char* argv[])
 	}
 
 	int index = 2;
-	std::string next_arg;
-	next_arg = argv[index++];
-	if (next_arg == "-3")	//triple-des
+	Thread_Placement placement;
+	bool numa = false;
+	bool stats = false;
+	std::string stats_json;
+	bool perf = false;
+	bool pool_metrics = false;
+	bool autotune_run = false;
+	bool explicit_threads = false;
+	bool explicit_engine = false;
+	std::string profile_path = default_profile_path();
+	std::string manifest;
+	bool recursive = false;
+	std::string daemon_socket;
+	bool pass_fds = false;
+	bool incremental = false;
+	// --shard index/count, range is known with input
+	int shard_index = 0;
+	int shard_count = 0;
+	bool explicit_range = false;
+	while (index < argc && argv[index][0] == '-')
 	{
-		crypter.triple_des = true;
-		next_arg = argv[index++];
-		if (next_arg != "eee3" && next_arg != "ede3")
+		std::string next_arg = argv[index++];
+		if (next_arg == "-3")	//triple-des
 		{
-			std::cout << "Error! Triple-DES modes EEE3 and EDE3 only supported.\n";
-			print_usage();
-			return 1;
+			crypter.triple_des = true;
+			next_arg = index < argc ? argv[index++] : "";
+			if (next_arg != "eee3" && next_arg != "ede3")
+			{
+				std::cout << "Error! Triple-DES modes EEE3 and EDE3 only supported.\n";
+				print_usage();
+				return 1;
+			}
+			if (next_arg == "eee3")
+			{
+				crypter.set_triple_des_mode(crypter.EEE3);
+			}
+			else//EDE3
+			{
+				crypter.set_triple_des_mode(crypter.EDE3);
+			}
+		}
+		else if (next_arg == "-mt")	//multithread mode
+		{
+			crypter.multithread = true;
+			explicit_threads = true;
+		}
+		else if (next_arg == "-pin")	//pinning of workers
+		{
+			next_arg = index < argc ? argv[index++] : "";
+			if (!Thread_Placement::parse(next_arg, placement))
+			{
+				std::cout << "Error! Pinning policy must be compact, scatter or cpu list.\n";
+				print_usage();
+				return 1;
+			}
+			crypter.multithread = true;
+			explicit_threads = true;
+		}
+		else if (next_arg == "-numa")	//per-node worker groups
+		{
+			numa = true;
+			crypter.multithread = true;
+			explicit_threads = true;
+		}
+		else if (next_arg == "--stats")	//statistics
+		{
+			stats = true;
+		}
+		else if (next_arg == "--stats-json")	//statistics for monitoring
+		{
+			stats_json = index < argc ? argv[index++] : "";
+			if (stats_json.empty())
+			{
+				std::cout << "Error! File name for statistics expected.\n";
+				print_usage();
+				return 1;
+			}
+		}
+		else if (next_arg == "--pool-metrics")	//thread pool telemetry
+		{
+			pool_metrics = true;
+		}
+		else if (next_arg == "--trace")	//timeline
+		{
+			next_arg = index < argc ? argv[index++] : "";
+			if (next_arg.empty())
+			{
+				std::cout << "Error! File name for trace expected.\n";
+				print_usage();
+				return 1;
+			}
+			if (!trace_write_at_exit(next_arg))
+			{
+				std::cout << "Warning! Tracer is not compiled in(define DES_TRACE), --trace is ignored.\n";
+			}
+		}
+		else if (next_arg == "--perf")	//hardware performance counters
+		{
+			perf = true;
+		}
+		else if (next_arg == "--engine")	//cipher engine
+		{
+			next_arg = index < argc ? argv[index++] : "";
+			if (parse_engine(next_arg) < 0)
+			{
+				std::cout << "Error! Engine must be reference or table.\n";
+				print_usage();
+				return 1;
+			}
+			crypter.engine = parse_engine(next_arg);
+			explicit_engine = true;
 		}
-		if (next_arg == "eee3")
+		else if (next_arg == "--autotune")	//calibration
 		{
-			crypter.set_triple_des_mode(crypter.EEE3);
+			autotune_run = true;
 		}
-		else//EDE3
+		else if (next_arg == "--profile")	//profile file
 		{
-			crypter.set_triple_des_mode(crypter.EDE3);
+			profile_path = index < argc ? argv[index++] : "";
+			if (profile_path.empty())
+			{
+				std::cout << "Error! File name for profile expected.\n";
+				print_usage();
+				return 1;
+			}
+		}
+		else if (next_arg == "--manifest")	//batch from file
+		{
+			manifest = index < argc ? argv[index++] : "";
+			if (manifest.empty())
+			{
+				std::cout << "Error! File name for manifest expected.\n";
+				print_usage();
+				return 1;
+			}
+		}
+		else if (next_arg == "-r")	//batch of directory tree
+		{
+			recursive = true;
+		}
+		else if (next_arg == "--via")	//client of daemon
+		{
+			daemon_socket = index < argc ? argv[index++] : "";
+			if (daemon_socket.empty())
+			{
+				std::cout << "Error! Socket of daemon expected.\n";
+				print_usage();
+				return 1;
+			}
+		}
+		else if (next_arg == "--pass-fds")	//descriptors instead of paths
+		{
+			pass_fds = true;
+		}
+		else if (next_arg == "--checksum")	//checksums in the same pass
+		{
+			next_arg = index < argc ? argv[index++] : "";
+			if (parse_checksum(next_arg) <= NO_CHECKSUM)
+			{
+				std::cout << "Error! Checksum must be crc32c or xxh64.\n";
+				print_usage();
+				return 1;
+			}
+			crypter.checksum = parse_checksum(next_arg);
+		}
+		else if (next_arg == "--incremental")	//changed chunks only
+		{
+			incremental = true;
+		}
+		else if (next_arg == "--range")	//part of input
+		{
+			next_arg = index < argc ? argv[index++] : "";
+			size_t colon = next_arg.find(':');
+			try
+			{
+				crypter.range_start = std::stoll(next_arg.substr(0, colon));
+				crypter.range_end = colon == std::string::npos || colon + 1 == next_arg.size() ? -1 : std::stoll(next_arg.substr(colon + 1));
+			}
+			catch (std::exception&)
+			{
+				colon = std::string::npos;
+			}
+			explicit_range = true;
+			if (colon == std::string::npos || crypter.range_start < 0 || crypter.range_start % BLOCKSIZE
+				|| (crypter.range_end >= 0 && crypter.range_end < crypter.range_start))
+			{
+				std::cout << "Error! Range must be start:end or start: with start multiple of " << BLOCKSIZE << ".\n";
+				print_usage();
+				return 1;
+			}
+		}
+		else if (next_arg == "--shard")	//part of input of equal shards
+		{
+			next_arg = index < argc ? argv[index++] : "";
+			size_t slash = next_arg.find('/');
+			try
+			{
+				shard_index = std::stoi(next_arg.substr(0, slash));
+				shard_count = std::stoi(next_arg.substr(slash + 1));
+			}
+			catch (std::exception&)
+			{
+				shard_count = 0;
+			}
+			if (slash == std::string::npos || shard_count <= 0 || shard_index < 0 || shard_index >= shard_count)
+			{
+				std::cout << "Error! Shard must be index/count with index from 0 to count - 1.\n";
+				print_usage();
+				return 1;
+			}
+		}
+		else if (next_arg == "--shared-output")	//ranges into one file
+		{
+			crypter.shared_output = true;
+		}
+		else if (next_arg == "--checkpoint")	//resumable run
+		{
+			crypter.checkpoint = index < argc ? argv[index++] : "";
+			if (crypter.checkpoint.empty())
+			{
+				std::cout << "Error! File name for checkpoint expected.\n";
+				print_usage();
+				return 1;
+			}
+		}
+		else
+		{
+			std::cout << "Error! Unknown setting " << next_arg << ".\n";
+			print_usage();
+			return 1;
+		}
+	}
+
+	// keys file, then pairs of files(pair of directories with -r, none is needed with --manifest)
+	int files = argc - index - 1;
+	if (files < 0 || files % 2 || (recursive && files != 2) || (manifest.empty() && files == 0))
+	{
+		std::cout << "Error! Not enough arguments.\n";
+		print_usage();
+		return 1;
+	}
+	bool batch = recursive || !manifest.empty() || files > 2;
+
+	crypter.kname = argv[index++];
+	if (!batch)
+	{
+		crypter.ifname = argv[index++];
+		crypter.ofname = argv[index++];
+		// messages must not get into encrypted data
+		if (crypter.ofname == "-")
+		{
+			std::cout.rdbuf(std::cerr.rdbuf());
 		}
 	}
-	else if (next_arg == "-mt")	//multithread mode
+
+	if (smode == "-d")
 	{
-		crypter.multithread = true;
+		crypter.mode = crypter.Decrypt;
 	}
 	else
 	{
-		--index;
+		crypter.mode = crypter.Encrypt;
 	}
-
-	next_arg = argv[index++];
-	if (next_arg == "-3")	//triple-des
+	if (crypter.checksum && (batch || !daemon_socket.empty()))
+	{
+		std::cout << "Error! Checksums are computed for one pair of files processed in this process.\n";
+		print_usage();
+		return 1;
+	}
+	if (incremental && (batch || !daemon_socket.empty() || crypter.checksum || crypter.ofname == "-"))
+	{
+		std::cout << "Error! Incremental mode takes one pair of files processed in this process, output can't be stdout.\n";
+		print_usage();
+		return 1;
+	}
+	if (!crypter.checkpoint.empty() && (batch || incremental || !daemon_socket.empty() || crypter.checksum
+		|| crypter.ifname == "-" || crypter.ofname == "-"))
+	{
+		std::cout << "Error! Checkpoint is made for one pair of files processed in this process.\n";
+		print_usage();
+		return 1;
+	}
+	// open range and shard end at the end of input(so range from 0 is a shard too)
+	bool ranged = shard_count || explicit_range;
+	if (ranged && (shard_count || crypter.range_end < 0))
 	{
-		crypter.triple_des = true;
-		next_arg = argv[index++];
-		if (next_arg != "eee3" && next_arg != "ede3")
+		std::error_code ec;
+		long long input_bytes = crypter.ifname == "-" ? -1 : (long long)std::filesystem::file_size(crypter.ifname, ec);
+		if (ec || input_bytes < 0)
 		{
-			std::cout << "Error! Triple-DES modes EEE3 and EDE3 only supported.\n";
+			std::cout << "Error! Range needs input file of known size.\n";
 			print_usage();
 			return 1;
 		}
-		if (next_arg == "eee3")
+		if (shard_count)
 		{
-			crypter.set_triple_des_mode(crypter.EEE3);
+			shard_range(input_bytes, shard_index, shard_count, crypter.range_start, crypter.range_end);
 		}
-		else//EDE3
+		else
 		{
-			crypter.set_triple_des_mode(crypter.EDE3);
+			crypter.range_end = std::max(crypter.range_start, input_bytes);
 		}
 	}
-	else if (next_arg == "-mt")	//multithread mode
-	{
-		crypter.multithread = true;
-	}
-	else
+	if ((ranged || crypter.shared_output) && (batch || incremental || !daemon_socket.empty() || !crypter.checkpoint.empty()
+		|| crypter.ifname == "-" || crypter.ofname == "-" || (crypter.shared_output && (!ranged || crypter.checksum))))
 	{
-		--index;
-	}
-	
-	if (argc < index + 3)
-	{
-		std::cout << "Error! Not enough arguments.\n";
+		std::cout << "Error! Range is processed for one pair of files in this process, input must be file, shared output - without checksums.\n";
 		print_usage();
 		return 1;
 	}
-
-	crypter.kname = argv[index++];
-	crypter.ifname = argv[index++];
-	crypter.ofname = argv[index++];
+	if (!daemon_socket.empty())
+	{
+		if (batch)
+		{
+			std::cout << "Error! Daemon takes one pair of files per request.\n";
+			print_usage();
+			return 1;
+		}
+		return run_client(daemon_socket, crypter, pass_fds);
+	}
 
 	if (crypter.read_keys())	
 	{
@@ -155,18 +672,87 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
-	if (smode == "-d")
+	Tuning_Profile profile;
+	bool tuned = false;
+	if (autotune_run)
 	{
-		crypter.mode = crypter.Decrypt;
+		std::cout << "Autotune:\n";
+		profile = autotune(crypter, std::cout);
+		tuned = true;
+		if (profile_path.empty() || !save_profile(profile_path, profile))
+		{
+			std::cout << "Warning! Could not save profile into " << profile_path << ".\n";
+		}
 	}
 	else
 	{
-		crypter.mode = crypter.Encrypt;
+		tuned = !profile_path.empty() && load_profile(profile_path, profile);
 	}
-	clock_t before = clock();
+	if (tuned)
+	{
+		crypter.buffer_size = profile.buffer_size;
+		crypter.io = profile.io;
+		if (!explicit_engine)
+		{
+			crypter.engine = profile.engine;
+		}
+		if (!explicit_threads)
+		{
+			crypter.multithread = profile.threads > 1;
+		}
+	}
+
+	// pools must outlive crypter.run()
+	std::unique_ptr<ThreadPoolMy> pinned_pool;
+	std::unique_ptr<Node_Pools> node_pools;
+	if (numa)
+	{
+		node_pools.reset(new Node_Pools());
+		crypter.node_pools = node_pools.get();
+	}
+	else if (placement.policy != Thread_Placement::None)
+	{
+		int threads = default_concurrency();
+		pinned_pool.reset(new ThreadPoolMy(threads, placement.cpus_for(threads, Cpu_Topology::detect())));
+		crypter.thread_pool = pinned_pool.get();
+	}
+	else if (tuned && crypter.multithread && profile.threads > 1)
+	{
+		// calling thread is working too
+		pinned_pool.reset(new ThreadPoolMy(profile.threads - 1));
+		crypter.thread_pool = pinned_pool.get();
+	}
+	std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+	double cpu_before = process_cpu_seconds();
+	uint64_t cycles_before = read_cycle_counter();
+	bool batch_failed = false;
 	try
 	{
-		if (crypter.run())	// error while opening file(s)
+		if (batch)
+		{
+			int failed = run_batch(crypter, manifest, recursive, argv + index, argc - index);
+			if (failed < 0)
+			{
+				print_usage();
+				return 1;
+			}
+			batch_failed = failed > 0;
+		}
+		else if (incremental)
+		{
+			Incremental_Crypter incremental_crypter(crypter);
+			incremental_crypter.thread_pool = crypter.thread_pool;
+			if (incremental_crypter.run())
+			{
+				std::cout << "Error! Incorrect file name.\n";
+				print_usage();
+				return(1);
+			}
+			std::cout << "Done, " << incremental_crypter.changed_chunks << " of " << incremental_crypter.chunks << " chunks written"
+				<< (incremental_crypter.full ? " (no valid manifest)" : "") << "\n";
+			crypter.stats = incremental_crypter.stats;
+		}
+		else if (crypter.run())	// error while opening file(s)
 		{
 			std::cout << "Error! Incorrect file name.\n";
 			print_usage();
@@ -174,7 +760,15 @@ int main(int argc, char* argv[])
 		}
 		else
 		{
+			if (crypter.resumed_bytes)
+			{
+				std::cout << "Resumed after " << crypter.resumed_bytes << " bytes done by interrupted run\n";
+			}
 			std::cout << "Done\n";
+			if (crypter.checksum)
+			{
+				print_checksums(crypter);
+			}
 		}
 	}
 	catch (std::runtime_error& err)
@@ -182,9 +776,58 @@ int main(int argc, char* argv[])
 		std::cout << "Error while processing: " << err.what() << ".\n";
 		return(1);
 	}
-	clock_t after = clock();
-	std::cout << "Elapsed: " << (after - before) << " ms" << std::endl;
+	Cli_Stats st;
+	st.cycles = read_cycle_counter() - cycles_before;
+	st.cpu_seconds = process_cpu_seconds() - cpu_before;
+	st.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+	st.run = crypter.stats;
+	std::cout << "Elapsed: " << (long long)(st.wall_seconds * 1000) << " ms" << std::endl;
+	if (stats)
+	{
+		print_stats(st);
+	}
+	if (pool_metrics)
+	{
+		// adaptive run of small input is singlethreaded in multithread mode too, so only pools that got tasks are printed
+		bool pool_used = false;
+		if (node_pools)
+		{
+			for (int node = 0; node < node_pools->nodes(); ++node)
+			{
+				Pool_Metrics metrics = node_pools->pool(node).metrics();
+				if (metrics.submitted_tasks)
+				{
+					std::cout << "Node " << node << " pool:\n";
+					print_metrics(std::cout, metrics);
+					pool_used = true;
+				}
+			}
+		}
+		else if (crypter.multithread && (pinned_pool || ThreadPoolMy::shared_created()))
+		{
+			// shared pool is created by the first run that needs it, report must not start it
+			Pool_Metrics metrics = (pinned_pool ? *pinned_pool : ThreadPoolMy::shared()).metrics();
+			if (metrics.submitted_tasks)
+			{
+				print_metrics(std::cout, metrics);
+				pool_used = true;
+			}
+		}
+		if (!pool_used)
+		{
+			std::cout << "No thread pool was used(singlethread run).\n";
+		}
+	}
+	if (perf)
+	{
+		perf_report(std::cout);
+	}
+	if (!stats_json.empty() && !write_stats_json(st, stats_json))
+	{
+		std::cout << "Error! Could not write statistics into " << stats_json << ".\n";
+		return 1;
+	}
 
-	return 0;
+	return batch_failed ? 1 : 0;
 }
 
@@ -0,0 +1,212 @@
+//
+// bench.cpp
+// Google Benchmark suite for cipher core, Triple-DES modes and file throughput.
+// Every benchmark reports bytes/s and cycles/byte(by rdtsc).
+//
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include "../DES/DESBuffer.h"
+#include "../DES/DESFileCrypt.h"
+
+/*-------------------------------------------------------------------------------------------------------*/
+
+/*
+Sets bytes/s and cycles/byte counters for benchmark that processed 'bytes' bytes every iteration
+*/
+static void report(benchmark::State& state, int64_t bytes, uint64_t cycles)
+{
+	int64_t total = bytes * state.iterations();
+	state.SetBytesProcessed(total);
+	state.counters["cycles/byte"] = total ? (double)cycles / total : 0;
+}
+
+static File_Crypter make_crypter(bool triple_des, int triple_des_mode)
+{
+	File_Crypter fc;
+	fc.mode = fc.Encrypt;
+	fc.set_3keys(generate_random64(), generate_random64(), generate_random64());
+	fc.triple_des = triple_des;
+	fc.set_triple_des_mode(triple_des_mode);
+	return fc;
+}
+
+/*
+Temporary file with random content, removed in destructor
+*/
+class Temp_File
+{
+public:
+	Temp_File(const std::string& fname_, int64_t size)
+		: fname{ fname_ }
+	{
+		std::ofstream ofs(fname, std::ios_base::binary);
+		std::vector<uint64_t> chunk(4096);
+		for (int64_t written = 0; ofs && written < size; written += chunk.size() * sizeof(uint64_t))
+		{
+			for (auto& v : chunk)
+			{
+				v = generate_random64();
+			}
+			ofs.write(reinterpret_cast<const char*>(chunk.data()), std::min<int64_t>(size - written, chunk.size() * sizeof(uint64_t)));
+		}
+		ok = (bool)ofs;
+	}
+	~Temp_File() { std::remove(fname.c_str()); }
+	std::string fname;
+	bool ok;
+};
+
+/*------------------------------------------------CORE---------------------------------------------------*/
+
+static void BM_DESEncrypterBlock(benchmark::State& state)
+{
+	uint64_t block = generate_random64();
+	uint64_t key = generate_random64();
+	uint64_t before = read_cycle_counter();
+	for (auto _ : state)
+	{
+		DESEncrypter encrypter{ block, key, DESEncrypter::ENCRYPT };
+		block = encrypter.run();
+		benchmark::DoNotOptimize(block);
+	}
+	report(state, BLOCKSIZE, read_cycle_counter() - before);
+}
+BENCHMARK(BM_DESEncrypterBlock);
+
+static void BM_KeySchedule(benchmark::State& state)
+{
+	uint64_t key = generate_random64();
+	uint64_t before = read_cycle_counter();
+	for (auto _ : state)
+	{
+		DESEncrypter encrypter{ 0, key, DESEncrypter::ENCRYPT };
+		auto keys = encrypter.round_keys();
+		benchmark::DoNotOptimize(keys);
+		key += keys[0];
+	}
+	// one key schedule per iteration, there are no bytes to count
+	state.SetItemsProcessed(state.iterations());
+	state.counters["cycles/key"] = state.iterations() ? (double)(read_cycle_counter() - before) / state.iterations() : 0;
+}
+BENCHMARK(BM_KeySchedule);
+
+/*
+run_des over N blocks.
+Args: blocks, cipher(0 - DES, 1 - EEE3, 2 - EDE3), engine(0 - reference, 1 - table)
+*/
+static void BM_RunDes(benchmark::State& state)
+{
+	const int blocks = state.range(0);
+	const int cipher = state.range(1);
+	File_Crypter fc = make_crypter(cipher != 0, cipher == 2 ? File_Crypter::EDE3 : File_Crypter::EEE3);
+	fc.engine = state.range(2);
+	std::vector<uint64_t> buffer(blocks);
+	for (auto& v : buffer)
+	{
+		v = generate_random64();
+	}
+	uint64_t before = read_cycle_counter();
+	for (auto _ : state)
+	{
+		fc.run_des(reinterpret_cast<char*>(buffer.data()), blocks);
+		benchmark::ClobberMemory();
+	}
+	report(state, (int64_t)blocks * BLOCKSIZE, read_cycle_counter() - before);
+	state.SetLabel(std::string(cipher == 0 ? "DES" : (cipher == 1 ? "EEE3" : "EDE3")) + (fc.engine == File_Crypter::Table ? ", table" : ", reference"));
+}
+BENCHMARK(BM_RunDes)->ArgsProduct({ { 1, 64, 4096 }, { 0, 1, 2 }, { File_Crypter::Reference, File_Crypter::Table } });
+
+/*
+Buffer API(encrypt of span) with table engine, in place.
+Args: bytes, threads(0 - singlethread)
+*/
+static void BM_EncryptBuffer(benchmark::State& state)
+{
+	const int bytes = state.range(0);
+	const int threads = state.range(1);
+	std::unique_ptr<ThreadPoolMy> pool;
+	Cipher_Config config(generate_random64());
+	if (threads)
+	{
+		pool.reset(new ThreadPoolMy(threads));
+		config.multithread = true;
+		config.thread_pool = pool.get();
+	}
+	std::vector<std::byte> buffer(bytes);
+	uint64_t before = read_cycle_counter();
+	for (auto _ : state)
+	{
+		encrypt(std::span<std::byte>(buffer), config);
+		benchmark::ClobberMemory();
+	}
+	report(state, bytes, read_cycle_counter() - before);
+}
+BENCHMARK(BM_EncryptBuffer)->ArgsProduct({ { 4096, 1024 * 1024 }, { 0, 4 } });
+
+/*------------------------------------------------FILES--------------------------------------------------*/
+
+const int64_t BENCH_FILE_SIZE = 4 * 1024 * 1024;
+
+/*
+File_Crypter::run from file to file.
+Args: buffer size, threads(0 - singlethread mode)
+*/
+static void file_throughput(benchmark::State& state, const std::string& dir)
+{
+	const int buffer_size = state.range(0);
+	const int threads = state.range(1);
+	Temp_File input(dir + "/desu_bench_input.bin", BENCH_FILE_SIZE);
+	std::string output = dir + "/desu_bench_output.bin";
+	if (!input.ok)
+	{
+		state.SkipWithError(("can not write into " + dir).c_str());
+		return;
+	}
+	std::unique_ptr<ThreadPoolMy> pool;
+	File_Crypter fc = make_crypter(false, File_Crypter::EEE3);
+	fc.ifname = input.fname;
+	fc.ofname = output;
+	fc.buffer_size = buffer_size;
+	if (threads)
+	{
+		pool.reset(new ThreadPoolMy(threads));
+		fc.multithread = true;
+		fc.adaptive = false;
+		fc.thread_pool = pool.get();
+	}
+	uint64_t before = read_cycle_counter();
+	for (auto _ : state)
+	{
+		if (fc.run())
+		{
+			state.SkipWithError("File_Crypter::run failed");
+			break;
+		}
+	}
+	report(state, BENCH_FILE_SIZE, read_cycle_counter() - before);
+	std::remove(output.c_str());
+}
+
+/*
+Files in memory(tmpfs) - only cipher, buffering and threads matter
+*/
+static void BM_FileInMemory(benchmark::State& state)
+{
+	file_throughput(state, "/dev/shm");
+}
+BENCHMARK(BM_FileInMemory)->ArgsProduct({ { 64 * 1024, 256 * 1024, 1024 * 1024 }, { 0, 1, 2, 4, 8 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/*
+Files on disk(current directory)
+*/
+static void BM_FileOnDisk(benchmark::State& state)
+{
+	file_throughput(state, ".");
+}
+BENCHMARK(BM_FileOnDisk)->ArgsProduct({ { 64 * 1024, 256 * 1024, 1024 * 1024 }, { 0, 1, 2, 4, 8 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
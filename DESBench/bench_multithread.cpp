@@ -0,0 +1,203 @@
+//
+// bench_multithread.cpp
+// Google Benchmark suite for Multithread primitives: threadsafe queues and ThreadPoolMy.
+// Use --benchmark_format=json(or --benchmark_out=file --benchmark_out_format=json) to compare runs.
+//
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../DES/Multithread/ThreadPoolMy.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static int64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count();
+}
+
+/*-----------------------------------------------QUEUES--------------------------------------------------*/
+
+const int ITEMS_PER_ITERATION = 100000;
+
+/*
+Producers push timestamps, consumers pop them and measure enqueue-to-dequeue latency.
+Negative value is a stop signal for consumer.
+Args: producers, consumers
+*/
+template<typename Queue>
+static void BM_QueueThroughput(benchmark::State& state)
+{
+	const int producers = state.range(0);
+	const int consumers = state.range(1);
+	double latency_sum = 0;
+	int64_t latency_max = 0;
+	for (auto _ : state)
+	{
+		Queue queue;
+		std::vector<double> sums(consumers, 0);
+		std::vector<int64_t> maxes(consumers, 0);
+		std::vector<std::thread> threads;
+		for (int c = 0; c < consumers; ++c)
+		{
+			threads.emplace_back([&queue, &sums, &maxes, c]()
+			{
+				int64_t value = 0;
+				while (true)
+				{
+					queue.wait_and_pop(value);
+					if (value < 0)
+					{
+						return;
+					}
+					int64_t latency = now_ns() - value;
+					sums[c] += latency;
+					maxes[c] = std::max(maxes[c], latency);
+				}
+			});
+		}
+		std::vector<std::thread> producer_threads;
+		for (int p = 0; p < producers; ++p)
+		{
+			producer_threads.emplace_back([&queue, producers]()
+			{
+				for (int i = 0; i < ITEMS_PER_ITERATION / producers; ++i)
+				{
+					queue.push(now_ns());
+				}
+			});
+		}
+		for (auto& thread : producer_threads)
+		{
+			thread.join();
+		}
+		for (int c = 0; c < consumers; ++c)
+		{
+			queue.push(-1);
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		for (int c = 0; c < consumers; ++c)
+		{
+			latency_sum += sums[c];
+			latency_max = std::max(latency_max, maxes[c]);
+		}
+	}
+	int64_t items = (int64_t)(ITEMS_PER_ITERATION / producers) * producers * state.iterations();
+	state.SetItemsProcessed(items);
+	state.counters["latency_avg_ns"] = items ? latency_sum / items : 0;
+	state.counters["latency_max_ns"] = (double)latency_max;
+}
+
+static void queue_args(benchmark::internal::Benchmark* b)
+{
+	int n = std::max(2u, std::thread::hardware_concurrency());
+	for (int producers = 1; producers <= n; producers *= 2)
+	{
+		for (int consumers = 1; consumers <= n; consumers *= 2)
+		{
+			b->Args({ producers, consumers });
+		}
+	}
+}
+BENCHMARK_TEMPLATE(BM_QueueThroughput, threadsafe_queue<int64_t>)->Apply(queue_args)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_QueueThroughput, threadsafe_queue_fg<int64_t>)->Apply(queue_args)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+/*------------------------------------------------POOL---------------------------------------------------*/
+
+const int TASKS_PER_ITERATION = 1000;
+
+/*
+Cost of pushing of no-op task with wait_do_task(including of wait_all_tasks at the end of portion).
+*/
+static void BM_PoolWaitDoTask(benchmark::State& state)
+{
+	ThreadPoolMy pool(state.range(0));
+	for (auto _ : state)
+	{
+		for (int i = 0; i < TASKS_PER_ITERATION; ++i)
+		{
+			pool.wait_do_task([]() {});
+		}
+		pool.wait_all_tasks();
+	}
+	state.SetItemsProcessed(state.iterations() * TASKS_PER_ITERATION);
+}
+BENCHMARK(BM_PoolWaitDoTask)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+/*
+Same with try_do_task, counts rejected submissions.
+*/
+static void BM_PoolTryDoTask(benchmark::State& state)
+{
+	ThreadPoolMy pool(state.range(0));
+	int64_t rejected = 0;
+	for (auto _ : state)
+	{
+		for (int i = 0; i < TASKS_PER_ITERATION; ++i)
+		{
+			if (!pool.try_do_task([]() {}))
+			{
+				++rejected;
+			}
+		}
+		pool.wait_all_tasks();
+	}
+	state.SetItemsProcessed(state.iterations() * TASKS_PER_ITERATION);
+	state.counters["rejected"] = benchmark::Counter((double)rejected, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_PoolTryDoTask)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+/*
+Round trip of one task: submission, execution by worker and getting of result by future.
+*/
+static void BM_PoolTaskRoundTrip(benchmark::State& state)
+{
+	ThreadPoolMy pool(state.range(0));
+	int value = 0;
+	for (auto _ : state)
+	{
+		value = pool.wait_do_task([value]() { return value + 1; }).get();
+	}
+	benchmark::DoNotOptimize(value);
+}
+BENCHMARK(BM_PoolTaskRoundTrip)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+/*
+wait_all_tasks on pool with state.range(1) queued no-op tasks(0 - on idle pool).
+*/
+static void BM_PoolWaitAllTasks(benchmark::State& state)
+{
+	ThreadPoolMy pool(state.range(0));
+	const int tasks = state.range(1);
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		for (int i = 0; i < tasks; ++i)
+		{
+			pool.wait_do_task([]() {});
+		}
+		state.ResumeTiming();
+		pool.wait_all_tasks();
+	}
+}
+BENCHMARK(BM_PoolWaitAllTasks)->ArgsProduct({ { 1, 4 }, { 0, 1, 100 } })->UseRealTime();
+
+/*
+Construction and teardown of pool with state.range(0) workers.
+*/
+static void BM_PoolLifetime(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		ThreadPoolMy pool(state.range(0));
+		benchmark::DoNotOptimize(pool.size());
+	}
+}
+BENCHMARK(BM_PoolLifetime)->RangeMultiplier(2)->Range(1, 16)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
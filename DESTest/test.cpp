@@ -1,7 +1,32 @@
 #include "pch.h"
 #include <ctime>
 #include <random>
+#include <sstream>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <filesystem>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "../DES/DESAsync.h"
+#include "../DES/DESAutotune.h"
+#include "../DES/DESBatch.h"
+#include "../DES/DESBuffer.h"
+#include "../DES/DESDaemon.h"
 #include "../DES/DESFileCrypt.h"
+#include "../DES/DESIncremental.h"
+#include "../DES/DESShard.h"
+#include "../DES/DESTrace.h"
 typedef unsigned char uchar;
 typedef unsigned long long ull;
 typedef unsigned int uint;
@@ -168,6 +193,260 @@ TEST(StableTest, DESTest)
 	}
 }
 
+/*-----------------------------------------REGRESSION----------------------------------------------------*/
+
+/*
+Regression(golden output) tests on input patterns of NIST SP 800-17(variable plaintext, variable key, substitution tables).
+These are NOT known-answer tests: this implementation uses its own key format(56 bits without parity),
+permutations and bit order, so it does not produce FIPS 46 ciphertexts and published SP 800-17 vectors don't pass.
+Expected values are outputs of reference DESEncrypter::run frozen to catch any change of it,
+other engines are checked against it by differential tests.
+*/
+struct Golden_Answer
+{
+	uint64_t key;
+	uint64_t plaintext;
+	uint64_t ciphertext;
+};
+
+// SP 800-17 key(64 bits, parity in least significant bit of every byte) to 56 bits key of DESEncrypter
+uint64_t key_without_parity(uint64_t key)
+{
+	uint64_t res = 0;
+	for (int byte = 7; byte >= 0; --byte)
+	{
+		res = (res << 7) | ((key >> (byte * 8 + 1)) & 0x7f);
+	}
+	return res;
+}
+
+// key 0(0101010101010101 without parity), plaintext - bit i set
+const std::array<uint64_t, 64> variable_plaintext_golden
+{
+	0x20CE31EABEE404E6, 0xE5A560BC91B377F1, 0x041D089B8899BEB0, 0x62658B2FBF90718B,
+	0x295C519CA5BFD42D, 0x90FA13AA9CD9B25A, 0x2D23FC1C6780F6E7, 0xDB3C740CE4BC0CDF,
+	0xA3820CEB1EC8CD29, 0x30729BEC3C80685D, 0x1F63F0FC3F620BB3, 0x08889BD97F032C34,
+	0xAD355416B6CA25C7, 0x246586FE9FF89C5A, 0x0511466478C50D53, 0x155F6A1D8224A953,
+	0x558FE30E59AD5115, 0xA9E7FA402247AF8B, 0xB6A6C9F3B5217BB6, 0x03B4A22048DB4CFF,
+	0x17CABDF93546101D, 0x647DE40FA01671EB, 0x680D4B691A678F6A, 0x94095513815BBAE1,
+	0x6A0F312321C8A375, 0x57A082C45D99C0CC, 0x1A7F2B94E1959551, 0xAFB6E641F95BEE90,
+	0x208C2E2B91E09AB8, 0x71689E80E9D473E2, 0xCED50CD7986DE546, 0xA7410F80B805A342,
+	0x98533F1BDFB5A773, 0xA3C03744856D20E2, 0x8B81593EB3D41182, 0x1D39EFBE31360922,
+	0x6DF4E0BA2D2B7922, 0x389730C90A76E806, 0x7F6C6D21CA2A714B, 0x40AFFD4C31B7827B,
+	0x8D3694BC5D1FD1E4, 0x5F5D7396429C093F, 0xE6987395293F69BC, 0xB1B45C8824B84259,
+	0x6A13A71F2FFFD0B4, 0x7392DB3507FDBD46, 0x7F75D993D70A94BB, 0x276BC10F4A336ADF,
+	0xF62E8E4B4B6FE707, 0x17E387E87DBB42F5, 0x28E6FD36D6B41D0E, 0x920C2BBB0BF40223,
+	0x764790BFEB8E44AE, 0xE6817BA445C466B2, 0xCFCCA6967DCA6948, 0x4D79C257CD9BEDD6,
+	0x3AC52BDEE5750432, 0x74E6C3F6DB8C70DA, 0xBE2F4EF400591BEB, 0xBAFD8597002B7F2B,
+	0xC8810104453D5010, 0xF1B0ED83243FFAFB, 0xAE40C32B4B5A567E, 0x8BF7C8CC8859C002
+};
+
+// plaintext 0, key - bit i of 56 set
+const std::array<uint64_t, 56> variable_key_golden
+{
+	0x54B2961A61E1FBE0, 0xD79DDA46F5859D6D, 0xC6A16E2E0BEE4D10, 0xAB33B8789D715E78,
+	0xBC846D1B27A0BDB2, 0x2D53FAC91DB34388, 0x6DE0027B820C584C, 0x6FE2C0A001884AEB,
+	0xA09FF2C17DEFF681, 0x4618165B017D2D89, 0xDD70ACCCB0F03D6F, 0x891392A2E0597668,
+	0x9F261AA95FF440F0, 0x87581DB707DFF079, 0x76D731311C87DFA5, 0x65DEA0BE2F7CFC4E,
+	0xB22F3B5A0876AEF0, 0xDEC4BE919336B773, 0x838E0F0D451477CC, 0xB4104BB0257A4172,
+	0xC42A8AC714D5B26F, 0xF3A84CD46296DC72, 0x814889DA63DE5D15, 0xFCCA1EF36390C38D,
+	0xAB7A6E3927044D8F, 0x86F12B13B244BB97, 0x6167074B91DC98B5, 0x42F0E4B2D03B9881,
+	0xE0B63EDA450B698E, 0xE5F8F0742D173A3F, 0xA7DC402C16C2DC96, 0x1487386410A47BCB,
+	0xEBED432B23D7318E, 0x3DB2BF5ED96EAB64, 0x5CDBDB6A573DE492, 0xB793CADF34D653CC,
+	0xA36E9D9C29E515F2, 0xDB86896DDCC38414, 0x733F49E1F3272B93, 0x6F450B295B7AFB58,
+	0xF848226587F745FA, 0x7EF5E6D43D686DF7, 0x31F6DFCF30C6F59E, 0x8AFA44D188E2F6A5,
+	0xC583560A0669AD7D, 0x1E2908EB969C04DC, 0xE6458C64659A4D3E, 0x2603264FF39A5542,
+	0xBA2E5003307AA7E9, 0x2A1A156EC8F13E27, 0xD1C161E78228DDCE, 0xEDC2620E2518F5AF,
+	0xAA2A98F49DF95C1F, 0x0EB8A0F74F3AC047, 0xAB5BB2F5D90D0ACD, 0x1689A3FFE0AC9929
+};
+
+// keys and plaintexts of SP 800-17 substitution table test, ciphertexts of DESEncrypter
+const std::vector<Golden_Answer> substitution_table_golden
+{
+	{ 0x7CA110454A1A6E57, 0x01A1D6D039776742, 0xDE98A9E07CAFAEBC },
+	{ 0x0131D9619DC1376E, 0x5CD54CA83DEF57DA, 0xBA081E73E56B70D4 },
+	{ 0x07A1133E4A0B2686, 0x0248D43806F67172, 0xE5043190BA47CA2C },
+	{ 0x3849674C2602319E, 0x51454B582DDF440A, 0x822A0EC3DFCFE63C },
+	{ 0x04B915BA43FEB5B6, 0x42FD443059577FA2, 0xF259C9BD50B2FC15 },
+	{ 0x0113B970FD34F2CE, 0x059B5E0851CF143A, 0x8A8B90DFE1ED9761 },
+	{ 0x0170F175468FB5E6, 0x0756D8E0774761D2, 0x12866DB907D15D83 },
+	{ 0x43297FAD38E373FE, 0x762514B829BF486A, 0xB094BF07A1A57232 },
+	{ 0x07A7137045DA2A16, 0x3BDD119049372802, 0xB19220412669C351 },
+	{ 0x04689104C2FD3B2F, 0x26955F6835AF609A, 0x908006738F734695 },
+	{ 0x37D06BB516CB7546, 0x164D5E404F275232, 0x0694FEC2D030F1A0 },
+	{ 0x1F08260D1AC2465E, 0x6B056E18759F5CCA, 0x2D2C4EEBD88E8698 },
+	{ 0x584023641ABA6176, 0x004BD6EF09176062, 0xFE5665F7315EAE5F },
+	{ 0x025816164629B007, 0x480D39006EE762F2, 0x799CCDD72D2C7155 },
+	{ 0x49793EBC79B3258F, 0x437540C8698F3CFA, 0x5DFCA5561DDAA57B },
+	{ 0x4FB05E1515AB73A7, 0x072D43A077075292, 0x74993A4963675E76 },
+	{ 0x49E95D6D4CA229BF, 0x02FE55778117F12A, 0xA70B202B105C7080 },
+	{ 0x018310DC409B26D6, 0x1D9D5C5018F728C2, 0x0D2B5E378D072350 },
+	{ 0x1C587F1C13924FEF, 0x305532286D6F295A, 0xD76278E412671AAD }
+};
+
+void check_golden_answer(uint64_t key, uint64_t plaintext, uint64_t ciphertext)
+{
+	DESEncrypter encr{ plaintext, key, DESEncrypter::ENCRYPT };
+	EXPECT_EQ(encr.run(), ciphertext) << std::hex << "key " << key << ", plaintext " << plaintext;
+	DESEncrypter decr{ ciphertext, key, DESEncrypter::DECRYPT };
+	EXPECT_EQ(decr.run(), plaintext) << std::hex << "key " << key << ", ciphertext " << ciphertext;
+}
+
+TEST(VariablePlaintextRegressionTest, DESTest)
+{
+	for (int i = 0; i < 64; ++i)
+	{
+		check_golden_answer(0, (uint64_t)1 << (63 - i), variable_plaintext_golden[i]);
+	}
+}
+
+TEST(VariableKeyRegressionTest, DESTest)
+{
+	for (int i = 0; i < 56; ++i)
+	{
+		check_golden_answer((uint64_t)1 << (55 - i), 0, variable_key_golden[i]);
+	}
+}
+
+TEST(SubstitutionTableRegressionTest, DESTest)
+{
+	for (const auto& answer : substitution_table_golden)
+	{
+		check_golden_answer(key_without_parity(answer.key), answer.plaintext, answer.ciphertext);
+	}
+}
+
+/*------------------------------------------DIFFERENTIAL-------------------------------------------------*/
+
+/*
+Block engine under test: processes 'count' blocks in place with 56 bits key in mode of DESEncrypter.
+Every engine must match reference DESEncrypter::run bit for bit.
+*/
+struct Test_Engine
+{
+	const char* name;
+	std::function<void(uint64_t* blocks, int count, uint64_t key, int mode)> run;
+};
+
+std::vector<Test_Engine> test_engines()
+{
+	return
+	{
+		{ "File_Crypter::run_des", [](uint64_t* blocks, int count, uint64_t key, int mode)
+			{
+				File_Crypter fc;
+				fc.set_key(key);
+				fc.mode = mode;
+				fc.run_des(reinterpret_cast<char*>(blocks), count);
+			} },
+		{ "File_Crypter::run_des, 3 portions on pool", [](uint64_t* blocks, int count, uint64_t key, int mode)
+			{
+				File_Crypter fc;
+				fc.set_key(key);
+				fc.mode = mode;
+				static ThreadPoolMy pool(2);
+				task_group group;
+				int portion = (count + 2) / 3;
+				for (int first = 0; first < count; first += portion)
+				{
+					char* buffer = reinterpret_cast<char*>(blocks + first);
+					int n = std::min(portion, count - first);
+					pool.wait_do_task([&fc, buffer, n]() { fc.run_des(buffer, n); }, group);
+				}
+				pool.wait_group(group);
+			} },
+		{ "table_des_block", [](uint64_t* blocks, int count, uint64_t key, int mode)
+			{
+				Key_Schedule schedule(key, mode);
+				for (int i = 0; i < count; ++i)
+				{
+					blocks[i] = table_des_block(blocks[i], schedule);
+				}
+			} },
+		{ "File_Crypter::run_des, table engine", [](uint64_t* blocks, int count, uint64_t key, int mode)
+			{
+				File_Crypter fc;
+				fc.engine = fc.Table;
+				fc.set_key(key);
+				fc.mode = mode;
+				fc.run_des(reinterpret_cast<char*>(blocks), count);
+			} },
+		{ "File_Crypter::run_des, table engine, prepared schedules", [](uint64_t* blocks, int count, uint64_t key, int mode)
+			{
+				File_Crypter fc;
+				fc.engine = fc.Table;
+				fc.set_key(~key);
+				fc.mode = mode;
+				fc.prepare_schedules();
+				// schedules prepared for other key must not be used
+				fc.set_key(key);
+				fc.run_des(reinterpret_cast<char*>(blocks), count / 2);
+				fc.prepare_schedules();
+				fc.run_des(reinterpret_cast<char*>(blocks + count / 2), count - count / 2);
+			} },
+	};
+}
+
+/*
+Number of random blocks for every engine and mode, DES_DIFF_BLOCKS environment variable overrides it
+(use billions for engine acceptance runs, default is small enough for every build).
+*/
+long long differential_blocks()
+{
+	const char* env = std::getenv("DES_DIFF_BLOCKS");
+	return env ? std::atoll(env) : 1 << 14;
+}
+
+TEST(DifferentialTest, DESTest)
+{
+	const long long total = differential_blocks();
+	const int BATCH = 256;
+	const uint64_t seed = std::random_device{}();
+	ThreadPoolMy& pool = ThreadPoolMy::shared();
+	for (const Test_Engine& engine : test_engines())
+	{
+		for (int mode : { DESEncrypter::ENCRYPT, DESEncrypter::DECRYPT })
+		{
+			std::atomic<long long> mismatches{ 0 };
+			std::atomic<long long> first_bad_batch{ -1 };
+			task_group group;
+			// batches are checked in parallel, every batch has its own key and generator seeded from(seed, batch)
+			for (long long batch = 0; batch * BATCH < total; ++batch)
+			{
+				pool.wait_do_task([&, batch, mode]()
+				{
+					std::mt19937_64 gen(seed ^ (batch * 0x9E3779B97F4A7C15ull));
+					uint64_t key = gen() & 0xFFFFFFFFFFFFFFull;
+					int count = (int)std::min<long long>(BATCH, total - batch * BATCH);
+					std::vector<uint64_t> blocks(count);
+					std::vector<uint64_t> expected(count);
+					for (int i = 0; i < count; ++i)
+					{
+						blocks[i] = gen();
+						DESEncrypter reference{ blocks[i], key, mode };
+						expected[i] = reference.run();
+					}
+					engine.run(blocks.data(), count, key, mode);
+					if (blocks != expected)
+					{
+						++mismatches;
+						long long none = -1;
+						first_bad_batch.compare_exchange_strong(none, batch);
+					}
+				}, group);
+				// do not queue more than needed at once for billions of blocks
+				if (group.tasks_left() > 4 * (pool.size() + 1))
+				{
+					pool.wait_group(group);
+				}
+			}
+			pool.wait_group(group);
+			EXPECT_EQ(mismatches.load(), 0) << engine.name << ", mode " << mode << ": first bad batch "
+				<< first_bad_batch.load() << ", seed " << seed;
+		}
+	}
+}
+
 TEST(PassFromStrTest, DESToolTest)
 {
 	std::string strpass = "neko";
@@ -514,4 +793,1505 @@ TEST(FileCryptMultithreadTripleDESTest, DESTest)
 		EXPECT_TRUE(are_files_equal(deffnames[i], dcrfnames[i], true));
 		EXPECT_FALSE(are_files_equal(crfnames[i], dcrfnames[i], true));
 	}
-}
\ No newline at end of file
+}
+TEST(FileCryptMultithreadEqualityTest, DESTest)
+{
+	init_vectors();
+	for (int i = 0; i < deffnames.size(); ++i)
+	{
+		File_Crypter fc;
+		fc.ifname = deffnames[i];
+		fc.set_key(generate_random64());
+		fc.mode = fc.Encrypt;
+
+		// multithread output must be the same as singlethread one
+		fc.ofname = crfnames[i];
+		fc.run();
+		fc.ofname = dcrfnames[i];
+		fc.multithread = true;
+		fc.run();
+
+		EXPECT_TRUE(are_files_equal(crfnames[i], dcrfnames[i]));
+	}
+}
+
+TEST(NestedTaskGroupTest, ThreadPoolTest)
+{
+	// outer tasks are waiting for their subtasks inside of workers,
+	// so it must not deadlock even with one worker
+	ThreadPoolMy pool(1);
+	std::atomic<int> done{ 0 };
+	task_group outer;
+	for (int i = 0; i < 4; ++i)
+	{
+		pool.wait_do_task([&pool, &done]()
+		{
+			task_group inner;
+			for (int j = 0; j < 8; ++j)
+			{
+				pool.wait_do_task([&done]() { ++done; }, inner);
+			}
+			pool.wait_group(inner);
+		}, outer);
+	}
+	pool.wait_group(outer);
+	EXPECT_EQ(done.load(), 32);
+	EXPECT_EQ(outer.tasks_left(), 0);
+}
+
+TEST(DroppedTasksTest, ThreadPoolTest)
+{
+	// tasks left in queue on destruction of pool release their group and futures
+	task_group group;
+	std::vector<std::future<void>> futures;
+	std::atomic<int> done{ 0 };
+	{
+		ThreadPoolMy pool(1);
+		pool.wait_do_task([]() { std::this_thread::sleep_for(std::chrono::milliseconds(50)); }, group);
+		for (int i = 0; i < 8; ++i)
+		{
+			futures.push_back(pool.wait_do_task([&done]() { ++done; }, group));
+		}
+	}
+	EXPECT_EQ(group.tasks_left(), 0);
+	int dropped = 0;
+	for (std::future<void>& fut : futures)
+	{
+		ASSERT_EQ(fut.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+		try
+		{
+			fut.get();
+		}
+		catch (const std::future_error& err)
+		{
+			EXPECT_EQ(err.code(), std::future_errc::broken_promise);
+			++dropped;
+		}
+	}
+	EXPECT_EQ(done.load() + dropped, 8);
+}
+
+TEST(TryDoTaskTest, ThreadPoolTest)
+{
+	// futures of try_do_task must become ready, task itself is pushed into queue
+	ThreadPoolMy pool(2);
+	std::vector<std::future<int>> futures;
+	for (int i = 0; i < 16; ++i)
+	{
+		std::future<int> fut;
+		while (!pool.try_do_task([i]() { return i * i; }, fut))
+		{
+			std::this_thread::yield();
+		}
+		futures.push_back(std::move(fut));
+	}
+	for (int i = 0; i < 16; ++i)
+	{
+		ASSERT_EQ(futures[i].wait_for(std::chrono::seconds(10)), std::future_status::ready);
+		EXPECT_EQ(futures[i].get(), i * i);
+	}
+	std::atomic<int> done{ 0 };
+	for (int i = 0; i < 16; ++i)
+	{
+		while (!pool.try_do_task([&done]() { ++done; }))
+		{
+			std::this_thread::yield();
+		}
+	}
+	pool.wait_all_tasks();
+	EXPECT_EQ(done.load(), 16);
+}
+
+TEST(SharedPoolTest, ThreadPoolTest)
+{
+	EXPECT_EQ(&ThreadPoolMy::shared(), &ThreadPoolMy::shared());
+	EXPECT_TRUE(ThreadPoolMy::shared_created());
+
+	// pools with idle and with busy workers must terminate without waiting for the queue
+	for (int i = 0; i < 100; ++i)
+	{
+		ThreadPoolMy pool(4);
+		if (i % 2)
+		{
+			for (int j = 0; j < 16; ++j)
+			{
+				pool.wait_do_task([]() { std::this_thread::sleep_for(std::chrono::microseconds(10)); });
+			}
+		}
+	}
+
+	// File_Crypter with its own pool
+	init_vectors();
+	ThreadPoolMy pool(2);
+	File_Crypter fc;
+	fc.ifname = deffnames[0];
+	fc.ofname = crfnames[0];
+	fc.set_key(generate_random64());
+	fc.mode = fc.Encrypt;
+	fc.multithread = true;
+	fc.thread_pool = &pool;
+	EXPECT_EQ(fc.run(), 0);
+	fc.ifname = crfnames[0];
+	fc.ofname = dcrfnames[0];
+	fc.mode = fc.Decrypt;
+	EXPECT_EQ(fc.run(), 0);
+	EXPECT_TRUE(are_files_equal(deffnames[0], dcrfnames[0], true));
+}
+
+TEST(CpuListTest, TopologyTest)
+{
+	EXPECT_EQ(parse_cpu_list("0-3,8,10-11\n"), std::vector<int>({ 0, 1, 2, 3, 8, 10, 11 }));
+	EXPECT_TRUE(parse_cpu_list("3-1").empty());
+	EXPECT_TRUE(parse_cpu_list("a").empty());
+
+	Cpu_Topology topology;
+	topology.nodes = { { 0, 1, 2, 3 }, { 4, 5, 6, 7 } };
+	Thread_Placement placement;
+	EXPECT_TRUE(Thread_Placement::parse("compact", placement));
+	EXPECT_EQ(placement.cpus_for(5, topology), std::vector<int>({ 0, 1, 2, 3, 4 }));
+	EXPECT_TRUE(Thread_Placement::parse("scatter", placement));
+	EXPECT_EQ(placement.cpus_for(5, topology), std::vector<int>({ 0, 4, 1, 5, 2 }));
+	EXPECT_TRUE(Thread_Placement::parse("6,2", placement));
+	EXPECT_EQ(placement.cpus_for(3, topology), std::vector<int>({ 6, 2, 6 }));
+	EXPECT_FALSE(Thread_Placement::parse("everywhere", placement));
+}
+
+TEST(FileCryptNumaTest, DESTest)
+{
+	init_vectors();
+	// two fake nodes on the first available CPU
+	Cpu_Topology topology;
+	int cpu = Cpu_Topology::detect().nodes[0][0];
+	topology.nodes = { { cpu }, { cpu } };
+	Node_Pools node_pools(topology, 2);
+	for (int i = 0; i < deffnames.size(); ++i)
+	{
+		File_Crypter fc;
+		fc.ifname = deffnames[i];
+		fc.set_key(generate_random64());
+		fc.mode = fc.Encrypt;
+
+		fc.ofname = crfnames[i];
+		fc.run();
+		fc.ofname = dcrfnames[i];
+		fc.multithread = true;
+		fc.node_pools = &node_pools;
+		fc.run();
+
+		EXPECT_TRUE(are_files_equal(crfnames[i], dcrfnames[i]));
+	}
+	// chunk buffers come from pools of nodes, not from shared one, and are kept for the next runs
+	for (int node = 0; node < node_pools.nodes(); ++node)
+	{
+		Buffer_Pool_Stats st = node_pools.buffer_pool(node).stats();
+		EXPECT_EQ(st.allocated, 1u);
+		EXPECT_EQ(st.reused, deffnames.size() - 1);
+	}
+}
+
+TEST(DefaultConcurrencyTest, TopologyTest)
+{
+	EXPECT_EQ(cpus_from_cgroup_cpu_max("max 100000"), 0);
+	EXPECT_EQ(cpus_from_cgroup_cpu_max("400000 100000\n"), 4);
+	EXPECT_EQ(cpus_from_cgroup_cpu_max("150000 100000"), 2);
+	EXPECT_EQ(cpus_from_cgroup_cpu_max("garbage"), 0);
+	EXPECT_EQ(cpus_from_cgroup_quota(-1, 100000), 0);
+	EXPECT_EQ(cpus_from_cgroup_quota(50000, 100000), 1);
+	EXPECT_GE(default_concurrency(), 1);
+}
+
+TEST(ParallelPortionsTest, DESTest)
+{
+	File_Crypter fc;
+	EXPECT_GT(fc.block_cost_ns(), 0);
+	// one block is never worth splitting, huge input is split as much as possible
+	EXPECT_EQ(fc.parallel_portions(BLOCKSIZE, 8), 1);
+	EXPECT_EQ(fc.parallel_portions(1LL << 40, 8), 8);
+	EXPECT_LE(fc.parallel_portions(BUFSIZE, 8), 8);
+}
+
+TEST(RunStatsTest, DESTest)
+{
+	init_vectors();
+	for (bool multithread : { false, true })
+	{
+		File_Crypter fc;
+		fc.ifname = deffnames[0];
+		fc.ofname = crfnames[0];
+		fc.set_key(generate_random64());
+		fc.mode = fc.Encrypt;
+		fc.multithread = multithread;
+		fc.adaptive = false;
+		ASSERT_EQ(fc.run(), 0);
+		EXPECT_EQ(fc.stats.bytes, get_file_size(deffnames[0]));
+		EXPECT_GE(fc.stats.read_seconds, 0);
+		EXPECT_GE(fc.stats.compute_seconds, 0);
+		EXPECT_GE(fc.stats.write_seconds, 0);
+	}
+	EXPECT_GE(process_cpu_seconds(), 0);
+}
+
+TEST(PerfCountersTest, DESTest)
+{
+	perf_reset();
+	DESEncrypter encrypter{ generate_random64(), generate_random64(), DESEncrypter::ENCRYPT };
+	encrypter.run();
+	Perf_Counts rounds = perf_counts(PERF_ROUNDS);
+	if (perf_counters_available())
+	{
+		EXPECT_EQ(rounds.calls, 1);
+		EXPECT_GT(rounds.instructions, 0);
+		EXPECT_GE(perf_counts(PERF_PERMUTATION).calls, 2 * ROUNDS);
+	}
+	else
+	{
+		EXPECT_EQ(rounds.calls, 0);
+	}
+	std::stringstream report;
+	perf_report(report);
+	EXPECT_FALSE(report.str().empty());
+}
+
+TEST(LatencyHistogramTest, PoolMetricsTest)
+{
+	// every value is in bucket with upper bound not less than value and relative error below 1/SUB_BUCKETS
+	for (uint64_t value : { 0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 40, ~0ull })
+	{
+		uint64_t upper = Latency_Histogram::bucket_upper_bound(Latency_Histogram::bucket_of(value));
+		EXPECT_GE(upper, value);
+		EXPECT_LE(upper - value, value / Latency_Histogram::SUB_BUCKETS);
+	}
+	Latency_Histogram histogram;
+	for (int i = 1; i <= 1000; ++i)
+	{
+		histogram.record(i);
+	}
+	Histogram_Snapshot snapshot = histogram.snapshot();
+	EXPECT_EQ(snapshot.total, 1000);
+	EXPECT_EQ(snapshot.max, 1000);
+	EXPECT_NEAR(snapshot.mean(), 500.5, 0.01);
+	EXPECT_NEAR((double)snapshot.percentile(50), 500, 500 / Latency_Histogram::SUB_BUCKETS);
+	EXPECT_EQ(snapshot.percentile(100), 1000);
+}
+
+TEST(PoolMetricsTest, ThreadPoolTest)
+{
+	ThreadPoolMy pool(2);
+	task_group group;
+	for (int i = 0; i < 100; ++i)
+	{
+		pool.wait_do_task([]() { std::this_thread::sleep_for(std::chrono::microseconds(10)); }, group);
+	}
+	// wait_group returns when tasks are done, wait_all_tasks - when their accounting is done too
+	pool.wait_group(group);
+	pool.wait_all_tasks();
+	Pool_Metrics metrics = pool.metrics();
+	EXPECT_EQ(metrics.submitted_tasks, 100);
+	EXPECT_EQ(metrics.queue_wait.total, 100);
+	EXPECT_EQ(metrics.execution.total, 100);
+	EXPECT_GE(metrics.execution.percentile(50), 10000);
+	EXPECT_EQ(metrics.queue_depth, 0);
+	EXPECT_GE(metrics.max_queue_depth, 1);
+	ASSERT_EQ(metrics.workers.size(), 2);
+	uint64_t by_workers = metrics.workers[0].tasks + metrics.workers[1].tasks;
+	EXPECT_EQ(by_workers + metrics.helped_tasks, 100);
+	EXPECT_GE(metrics.utilization(), 0);
+	EXPECT_LE(metrics.utilization(), 1);
+	std::stringstream report;
+	print_metrics(report, metrics);
+	EXPECT_FALSE(report.str().empty());
+}
+
+TEST(TraceTest, DESTest)
+{
+	init_vectors();
+	if (!trace_enable())
+	{
+		// compiled out
+		EXPECT_FALSE(trace_write("trace_test.json"));
+		return;
+	}
+	File_Crypter fc;
+	fc.ifname = deffnames[0];
+	fc.ofname = crfnames[0];
+	fc.set_key(generate_random64());
+	fc.mode = fc.Encrypt;
+	fc.multithread = true;
+	fc.adaptive = false;
+	fc.run();
+	trace_disable();
+	ASSERT_TRUE(trace_write("trace_test.json"));
+	std::ifstream ifs("trace_test.json");
+	std::string json((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+	EXPECT_NE(json.find("\"name\": \"read\""), std::string::npos);
+	EXPECT_NE(json.find("\"name\": \"run_des\""), std::string::npos);
+	EXPECT_NE(json.find("\"name\": \"write\""), std::string::npos);
+	ifs.close();
+	std::remove("trace_test.json");
+}
+
+TEST(BulkQueueTest, ThreadsafeQueueTest)
+{
+	threadsafe_queue<int> queue;
+	threadsafe_queue_fg<int> queue_fg;
+	std::vector<int> values{ 1, 2, 3, 4, 5 };
+	queue.push_bulk(std::vector<int>(values));
+	queue_fg.push_bulk(std::vector<int>(values));
+	queue_fg.push(6);
+
+	std::vector<int> popped;
+	EXPECT_EQ(queue.try_pop_bulk(std::back_inserter(popped), 3), 3);
+	EXPECT_EQ(queue.wait_and_pop_bulk(std::back_inserter(popped), 10), 2);
+	EXPECT_EQ(queue.try_pop_bulk(std::back_inserter(popped), 10), 0);
+	EXPECT_EQ(popped, values);
+
+	popped.clear();
+	EXPECT_EQ(queue_fg.try_pop_bulk(std::back_inserter(popped), 2), 2);
+	EXPECT_EQ(queue_fg.wait_and_pop_bulk(std::back_inserter(popped), 10), 4);
+	EXPECT_EQ(popped, std::vector<int>({ 1, 2, 3, 4, 5, 6 }));
+	EXPECT_TRUE(queue_fg.empty());
+}
+
+TEST(BoundedQueueTest, ThreadsafeQueueTest)
+{
+	threadsafe_bounded_queue<int> queue(4);
+	EXPECT_TRUE(queue.try_push(0));
+	queue.push_bulk(std::vector<int>({ 1, 2, 3 }));
+	EXPECT_FALSE(queue.try_push(4));
+
+	// producer is blocked until consumer makes space
+	const int n = 1000;
+	std::thread producer([&queue]()
+	{
+		std::vector<int> values;
+		for (int i = 4; i < n; ++i)
+		{
+			values.push_back(i);
+		}
+		queue.push_bulk(values);
+	});
+	std::vector<int> popped;
+	while (popped.size() < n)
+	{
+		EXPECT_LE(queue.size(), queue.capacity());
+		queue.wait_and_pop_bulk(std::back_inserter(popped), 3);
+	}
+	producer.join();
+	for (int i = 0; i < n; ++i)
+	{
+		EXPECT_EQ(popped[i], i);
+	}
+}
+
+/*
+Directory for temporary files: tmpfs if there is one, so round trips are done in memory
+*/
+std::string memory_dir()
+{
+	std::ofstream probe("/dev/shm/desu_probe");
+	if (probe)
+	{
+		probe.close();
+		std::remove("/dev/shm/desu_probe");
+		return "/dev/shm/";
+	}
+	return "";
+}
+
+TEST(FileRoundTripAllModesTest, DESTest)
+{
+	const std::string dir = memory_dir();
+	const std::string plain = dir + "desu_roundtrip.bin";
+	const std::string encrypted = dir + "desu_roundtrip.enc";
+	const std::string decrypted = dir + "desu_roundtrip_d.bin";
+	const std::string reference = dir + "desu_roundtrip_ref.enc";
+	Node_Pools node_pools(Cpu_Topology::detect(), 1);
+	// small chunks, so files of few chunks cover all chunk boundary cases fast
+	const int chunk = 4096;
+	for (int size : { 0, 1, 7, 8, 9, chunk - 1, chunk + 13, 3 * chunk })
+	{
+		std::vector<char> data(size);
+		for (auto& c : data)
+		{
+			c = (char)generate_random64();
+		}
+		{
+			std::ofstream ofs(plain, std::ios_base::binary);
+			ofs.write(data.data(), data.size());
+		}
+		// cipher: 0 - DES, 1 - EEE3, 2 - EDE3; threading: 0 - single, 1 - pool, 2 - NUMA pools
+		// reference is written by singlethread reference engine, every other combination must match it
+		for (int cipher = 0; cipher < 3; ++cipher)
+		{
+			File_Crypter fc;
+			fc.set_3keys(generate_random64(), generate_random64(), generate_random64());
+			fc.triple_des = cipher != 0;
+			fc.set_triple_des_mode(cipher == 2 ? fc.EDE3 : fc.EEE3);
+			fc.adaptive = false;
+			fc.buffer_size = chunk;
+			for (int run = 0; run < 6; ++run)
+			{
+				int threading = run % 3;
+				fc.engine = run < 3 ? fc.Reference : fc.Table;
+				fc.multithread = threading != 0;
+				fc.node_pools = threading == 2 ? &node_pools : nullptr;
+				fc.mode = fc.Encrypt;
+				fc.ifname = plain;
+				fc.ofname = run == 0 ? reference : encrypted;
+				ASSERT_EQ(fc.run(), 0);
+				fc.mode = fc.Decrypt;
+				fc.ifname = fc.ofname;
+				fc.ofname = decrypted;
+				ASSERT_EQ(fc.run(), 0);
+				EXPECT_TRUE(are_files_equal(plain, decrypted, true)) << "size " << size << ", cipher " << cipher << ", run " << run;
+				if (run != 0)
+				{
+					EXPECT_TRUE(are_files_equal(reference, encrypted)) << "size " << size << ", cipher " << cipher << ", run " << run;
+				}
+			}
+		}
+	}
+	for (const std::string& fname : { plain, encrypted, decrypted, reference })
+	{
+		std::remove(fname.c_str());
+	}
+}
+
+TEST(ProfileTest, DESTest)
+{
+	const std::string fname = memory_dir() + "desu_test.profile";
+	Tuning_Profile saved;
+	saved.engine = File_Crypter::Table;
+	saved.threads = 3;
+	saved.buffer_size = 256 * 1024;
+	saved.io = IO_FD;
+	ASSERT_TRUE(save_profile(fname, saved));
+	Tuning_Profile loaded;
+	ASSERT_TRUE(load_profile(fname, loaded));
+	EXPECT_EQ(loaded.engine, saved.engine);
+	EXPECT_EQ(loaded.threads, saved.threads);
+	EXPECT_EQ(loaded.buffer_size, saved.buffer_size);
+	EXPECT_EQ(loaded.io, saved.io);
+
+	// profile of another host is not used
+	{
+		std::ofstream ofs(fname);
+		ofs << "host=some-other-host\nengine=table\nthreads=2\nbuffer_size=65536\nio=stream\n";
+	}
+	EXPECT_FALSE(load_profile(fname, loaded));
+	EXPECT_EQ(loaded.threads, saved.threads);
+	std::remove(fname.c_str());
+	EXPECT_FALSE(load_profile(fname, loaded));
+}
+
+TEST(AutotuneTest, DESTest)
+{
+	File_Crypter fc;
+	fc.set_key(generate_random64());
+	fc.mode = fc.Encrypt;
+	fc.ifname = "Files/1.png";
+	std::ostringstream log;
+	Tuning_Profile profile = autotune(fc, log);
+	// table engine does the same work with fewer operations
+	EXPECT_EQ(profile.engine, File_Crypter::Table) << log.str();
+	EXPECT_GE(profile.threads, 1);
+	EXPECT_LE(profile.threads, default_concurrency());
+	EXPECT_GE(profile.buffer_size, BLOCKSIZE);
+	EXPECT_TRUE(profile.io == IO_STREAM || profile.io == IO_FD);
+}
+
+TEST(BufferPoolTest, BufferPoolTest)
+{
+	// heap buffers and fresh pages(buffers of NUMA node pools) behave the same
+	for (bool fresh_pages : { false, true })
+	{
+		Buffer_Pool pool(true, fresh_pages);
+		{
+			Pooled_Buffer small(100, pool);
+			Pooled_Buffer chunk(BUFSIZE, pool);
+			EXPECT_EQ(reinterpret_cast<uintptr_t>(small.get()) % Buffer_Pool::ALIGNMENT, 0u);
+			EXPECT_EQ(reinterpret_cast<uintptr_t>(chunk.get()) % Buffer_Pool::ALIGNMENT, 0u);
+			memset(chunk.get(), 0x5a, BUFSIZE);
+		}
+		EXPECT_EQ(pool.stats().allocated, 2u);
+		// the same size classes are reused
+		for (int i = 0; i < 10; ++i)
+		{
+			Pooled_Buffer chunk(BUFSIZE - 17, pool);
+			Pooled_Buffer small(4096, pool);
+		}
+		EXPECT_EQ(pool.stats().allocated, 2u);
+		EXPECT_EQ(pool.stats().reused, 20u);
+		// huge page class is aligned to huge page
+		Pooled_Buffer huge(Buffer_Pool::HUGE_PAGE_SIZE, pool);
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(huge.get()) % Buffer_Pool::HUGE_PAGE_SIZE, 0u);
+		huge.reset();
+		pool.trim();
+		Pooled_Buffer after_trim(BUFSIZE, pool);
+		EXPECT_EQ(pool.stats().allocated, 4u);
+	}
+}
+
+TEST(ConcurrentBufferPoolTest, BufferPoolTest)
+{
+	Buffer_Pool pool;
+	const int THREADS = 4;
+	const int ROUNDS = 20000;
+	std::atomic<int> errors{ 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREADS; ++t)
+	{
+		threads.emplace_back([&pool, &errors, t]()
+		{
+			for (int i = 0; i < ROUNDS; ++i)
+			{
+				// buffer given to two threads at once would have other thread's mark
+				Pooled_Buffer a(8192, pool);
+				Pooled_Buffer b(8192, pool);
+				a.get()[100] = (char)t;
+				b.get()[100] = (char)(t + THREADS);
+				std::this_thread::yield();
+				if (a.get()[100] != (char)t || b.get()[100] != (char)(t + THREADS))
+				{
+					++errors;
+				}
+			}
+		});
+	}
+	for (auto& th : threads)
+	{
+		th.join();
+	}
+	EXPECT_EQ(errors.load(), 0);
+	EXPECT_LE(pool.stats().allocated, (uint64_t)(2 * THREADS));
+}
+
+TEST(SharedBufferPoolTest, BufferPoolTest)
+{
+	Buffer_Pool& pool = Buffer_Pool::shared();
+	char* first;
+	{
+		Pooled_Buffer buffer(3 * 4096);
+		first = buffer.get();
+	}
+	// thread cache gives back the last released buffer
+	Pooled_Buffer again(4 * 4096);
+	EXPECT_EQ(again.get(), first);
+	Buffer_Pool_Stats before = pool.stats();
+	std::string fname = "Files/1.png";
+	EXPECT_TRUE(are_files_equal(fname, fname));
+	EXPECT_TRUE(are_files_equal(fname, fname));
+	EXPECT_LE(pool.stats().allocated - before.allocated, 2u);
+}
+
+TEST(BatchTest, DESTest)
+{
+	namespace fs = std::filesystem;
+	const fs::path root = memory_dir() + "desu_batch";
+	fs::remove_all(root);
+	fs::create_directories(root / "in" / "sub");
+	const int chunk = 4096;
+	// empty, smaller than block, several files per pack, file of several packs
+	const std::vector<std::string> names = { "empty", "a", "b", "sub/c", "sub/d" };
+	const std::vector<int> sizes = { 0, 5, 1000, chunk + 13, 5 * chunk };
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		std::ofstream ofs(root / "in" / names[i], std::ios_base::binary);
+		for (int j = 0; j < sizes[i]; ++j)
+		{
+			ofs.put((char)generate_random64());
+		}
+	}
+	File_Crypter fc;
+	fc.set_3keys(generate_random64(), generate_random64(), generate_random64());
+	fc.triple_des = true;
+	fc.set_triple_des_mode(fc.EDE3);
+	fc.mode = fc.Encrypt;
+	fc.buffer_size = chunk;
+	ThreadPoolMy pool(2);
+
+	Batch_Crypter batch(fc);
+	batch.thread_pool = &pool;
+	batch.max_in_flight = 2;
+	ASSERT_EQ(batch.add_tree((root / "in").string(), (root / "out").string()), (int)names.size());
+	Batch_Item missing;
+	missing.ifname = (root / "missing").string();
+	missing.ofname = (root / "missing.enc").string();
+	batch.items.push_back(missing);
+	EXPECT_EQ(batch.run(), 1);
+	EXPECT_TRUE(batch.items.back().failed);
+	EXPECT_EQ(batch.stats.bytes, 1005 + chunk + 13 + 5 * chunk);
+
+	// every output is the same as of File_Crypter::run
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		fc.ifname = (root / "in" / names[i]).string();
+		fc.ofname = (root / "single.enc").string();
+		ASSERT_EQ(fc.run(), 0);
+		EXPECT_TRUE(are_files_equal(fc.ofname, (root / "out" / names[i]).string())) << names[i];
+	}
+
+	// manifest of decryption back
+	{
+		std::ofstream ofs(root / "manifest.txt");
+		ofs << "# decrypt\n";
+		for (const std::string& name : names)
+		{
+			ofs << (root / "out" / name).string() << "\t" << (root / "out" / (name + ".d")).string() << "\n";
+		}
+	}
+	fc.mode = fc.Decrypt;
+	Batch_Crypter back(fc);
+	back.thread_pool = &pool;
+	ASSERT_EQ(back.add_manifest((root / "manifest.txt").string()), (int)names.size());
+	EXPECT_EQ(back.run(), 0);
+	for (const std::string& name : names)
+	{
+		EXPECT_TRUE(are_files_equal((root / "in" / name).string(), (root / "out" / (name + ".d")).string(), true)) << name;
+	}
+	fs::remove_all(root);
+}
+
+#ifndef _WIN32
+TEST(DaemonTest, DESTest)
+{
+	const std::string dir = memory_dir();
+	const std::string socket_path = dir + "desu_test.sock";
+	const std::string kname = dir + "desu_daemon.key";
+	const std::string plain = "Files/1.png";
+	const std::string local = dir + "desu_daemon_local.enc";
+	const std::string remote = dir + "desu_daemon_remote.enc";
+	File_Crypter fc;
+	fc.set_3keys(generate_random64(), generate_random64(), generate_random64());
+	fc.ofname = kname;
+	ASSERT_EQ(fc.write_keys(), 0);
+	fc.triple_des = true;
+	fc.set_triple_des_mode(fc.EDE3);
+	fc.mode = fc.Encrypt;
+	fc.ifname = plain;
+	fc.ofname = local;
+	ASSERT_EQ(fc.run(), 0);
+
+	ThreadPoolMy pool(2);
+	DES_Daemon daemon(pool, 2);
+	daemon.client_timeout_seconds = 1;
+	ASSERT_EQ(daemon.listen(socket_path), 0);
+	// only user of daemon may connect
+	struct stat st;
+	ASSERT_EQ(stat(socket_path.c_str(), &st), 0);
+	EXPECT_EQ(st.st_mode & 0777, 0600u);
+	std::thread server([&daemon]() { daemon.serve(); });
+
+	Daemon_Request request;
+	request.op = File_Crypter::Encrypt;
+	request.cipher = 2;
+	request.kname = kname;
+	request.ifname = plain;
+	request.ofname = remote;
+	Daemon_Response response;
+	ASSERT_TRUE(daemon_call(socket_path, request, response));
+	EXPECT_EQ(response.status, 0) << response.message;
+	EXPECT_EQ(response.bytes, get_file_size(plain));
+	EXPECT_TRUE(are_files_equal(local, remote));
+
+	// descriptors instead of paths
+	std::remove(remote.c_str());
+	request.kind = Daemon_Request::Fds;
+	request.in_fd = open(plain.c_str(), O_RDONLY);
+	request.out_fd = open(remote.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	ASSERT_TRUE(daemon_call(socket_path, request, response));
+	close(request.in_fd);
+	close(request.out_fd);
+	EXPECT_EQ(response.status, 0) << response.message;
+	EXPECT_TRUE(are_files_equal(local, remote));
+
+	// inline buffer comes back encrypted and padded
+	request = Daemon_Request{};
+	request.kind = Daemon_Request::Buffer;
+	request.op = File_Crypter::Encrypt;
+	request.cipher = 2;
+	request.kname = kname;
+	request.data = { 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i' };
+	ASSERT_TRUE(daemon_call(socket_path, request, response));
+	ASSERT_EQ(response.data.size(), 16u);
+	std::vector<char> expected = request.data;
+	expected.resize(16, 0);
+	fc.run_des(expected.data(), 2);
+	EXPECT_EQ(response.data, expected);
+	EXPECT_EQ(daemon.cache.misses(), 1u);
+	EXPECT_EQ(daemon.cache.hits(), 2u);
+
+	// silent client is dropped after timeout, daemon keeps serving
+	int silent = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path.c_str());
+	ASSERT_EQ(connect(silent, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+	ASSERT_TRUE(daemon_call(socket_path, request, response));
+	EXPECT_EQ(response.status, 0) << response.message;
+	close(silent);
+
+	// key file rewritten twice within one second(same size, likely the same mtime) is read again every time
+	for (int i = 0; i < 2; ++i)
+	{
+		File_Crypter rekeyed;
+		rekeyed.set_3keys(generate_random64(), generate_random64(), generate_random64());
+		rekeyed.ofname = kname;
+		ASSERT_EQ(rekeyed.write_keys(), 0);
+		rekeyed.triple_des = true;
+		rekeyed.set_triple_des_mode(rekeyed.EDE3);
+		rekeyed.mode = rekeyed.Encrypt;
+		ASSERT_TRUE(daemon_call(socket_path, request, response));
+		expected = request.data;
+		expected.resize(16, 0);
+		rekeyed.run_des(expected.data(), 2);
+		EXPECT_EQ(response.data, expected);
+	}
+
+	// errors are reported, daemon keeps serving
+	request.kname = dir + "desu_no_such.key";
+	ASSERT_TRUE(daemon_call(socket_path, request, response));
+	EXPECT_NE(response.status, 0);
+
+	request = Daemon_Request{};
+	request.op = Daemon_Request::Shutdown;
+	ASSERT_TRUE(daemon_call(socket_path, request, response));
+	server.join();
+	for (const std::string& fname : { kname, local, remote })
+	{
+		std::remove(fname.c_str());
+	}
+}
+#endif
+
+TEST(OverlappedRunTest, DESTest)
+{
+	// many chunks, so reading, processing and writing of neighbour chunks overlap
+	const std::string dir = memory_dir();
+	const std::string plain = "Files/1.png";
+	const std::string single = dir + "desu_overlap_st.enc";
+	const std::string multi = dir + "desu_overlap_mt.enc";
+	ThreadPoolMy pool(3);
+	File_Crypter fc;
+	fc.set_key(generate_random64());
+	fc.mode = fc.Encrypt;
+	fc.engine = File_Crypter::Table;
+	fc.buffer_size = 4096 + 3;
+	fc.ifname = plain;
+	fc.ofname = single;
+	ASSERT_EQ(fc.run(), 0);
+	fc.multithread = true;
+	fc.adaptive = false;
+	fc.thread_pool = &pool;
+	fc.ofname = multi;
+	ASSERT_EQ(fc.run(), 0);
+	EXPECT_EQ(fc.stats.bytes, get_file_size(plain));
+	EXPECT_TRUE(are_files_equal(single, multi));
+	// the same with inline pool, where calling thread does all portions
+	ThreadPoolMy inline_pool(0);
+	fc.thread_pool = &inline_pool;
+	ASSERT_EQ(fc.run(), 0);
+	EXPECT_TRUE(are_files_equal(single, multi));
+	fc.ifname = dir + "desu_no_such_file";
+	EXPECT_EQ(fc.run(), -1);
+	std::remove(single.c_str());
+	std::remove(multi.c_str());
+}
+
+#ifndef _WIN32
+TEST(StreamTest, DESTest)
+{
+	const std::string dir = memory_dir();
+	const std::string plain = "Files/1.png";
+	const std::string expected = dir + "desu_stream_file.enc";
+	const std::string piped = dir + "desu_stream_pipe.enc";
+	File_Crypter fc;
+	fc.set_key(generate_random64());
+	fc.mode = fc.Encrypt;
+	fc.ifname = plain;
+	fc.ofname = expected;
+	ASSERT_EQ(fc.run(), 0);
+
+	// input comes from pipe in small writes, size of input is unknown
+	int fds[2];
+	ASSERT_EQ(pipe(fds), 0);
+	std::thread feeder([&plain, fds]()
+	{
+		std::unique_ptr<Byte_Reader> in = open_reader(plain);
+		Fd_Writer out(fds[1], true);
+		char buffer[1000];
+		for (int got = in->read(buffer, sizeof(buffer)); got > 0; got = in->read(buffer, sizeof(buffer)))
+		{
+			out.write(buffer, got);
+		}
+	});
+	for (bool multithread : { false, true })
+	{
+		SCOPED_TRACE(multithread);
+		Fd_Reader reader(fds[0], false);
+		// pipe in the first pass, regular file in the second
+		EXPECT_EQ(reader.size(), multithread ? get_file_size(plain) : -1);
+		std::unique_ptr<Byte_Writer> writer = open_writer(piped, IO_FD);
+		ASSERT_TRUE(writer);
+		fc.reader = &reader;
+		fc.writer = writer.get();
+		fc.multithread = multithread;
+		fc.buffer_size = 64 * 1024;
+		ASSERT_EQ(fc.run(), 0);
+		writer.reset();
+		if (!multithread)
+		{
+			feeder.join();
+			EXPECT_EQ(fc.stats.bytes, get_file_size(plain));
+			EXPECT_TRUE(are_files_equal(expected, piped));
+			// second pass reads the file with descriptors
+			close(fds[0]);
+			fds[0] = open(plain.c_str(), O_RDONLY);
+			ASSERT_GE(fds[0], 0);
+		}
+		else
+		{
+			EXPECT_TRUE(are_files_equal(expected, piped));
+		}
+	}
+	close(fds[0]);
+	std::remove(expected.c_str());
+	std::remove(piped.c_str());
+}
+#endif
+
+TEST(BufferApiTest, DESTest)
+{
+	ThreadPoolMy pool(3);
+	const uint64_t k1 = generate_random64(), k2 = generate_random64(), k3 = generate_random64();
+	std::vector<std::byte> plain(100003);
+	for (std::byte& b : plain)
+	{
+		b = std::byte(generate_random64());
+	}
+	std::vector<std::byte> padded = plain;
+	padded.resize(padded_size(plain.size()), std::byte(0));
+
+	for (int cipher = 0; cipher < 3; ++cipher)
+	{
+		Cipher_Config config = cipher == 0 ? Cipher_Config(k1) : Cipher_Config(k1, k2, k3, cipher == 1 ? File_Crypter::EEE3 : File_Crypter::EDE3);
+		// reference: run_des of File_Crypter with the same keys
+		File_Crypter fc;
+		if (cipher == 0)
+		{
+			fc.set_key(k1);
+		}
+		else
+		{
+			fc.set_3keys(k1, k2, k3);
+			fc.triple_des = true;
+			fc.set_triple_des_mode(cipher == 1 ? fc.EEE3 : fc.EDE3);
+		}
+		fc.mode = fc.Encrypt;
+		std::vector<std::byte> expected = padded;
+		fc.run_des(reinterpret_cast<char*>(expected.data()), expected.size() / BLOCKSIZE);
+
+		for (int engine : { File_Crypter::Reference, File_Crypter::Table })
+		{
+			for (bool multithread : { false, true })
+			{
+				SCOPED_TRACE(std::to_string(cipher) + " " + engine_name(engine) + (multithread ? " mt" : ""));
+				config.engine = engine;
+				config.multithread = multithread;
+				config.thread_pool = &pool;
+				std::vector<std::byte> encrypted(padded.size());
+				ASSERT_EQ(encrypt(plain, encrypted, config), (long long)padded.size());
+				EXPECT_EQ(encrypted, expected);
+				std::vector<std::byte> decrypted(padded.size());
+				ASSERT_EQ(decrypt(encrypted, decrypted, config), (long long)padded.size());
+				EXPECT_EQ(decrypted, padded);
+				// in place
+				ASSERT_EQ(decrypt(std::span<std::byte>(encrypted), config), (long long)padded.size());
+				EXPECT_EQ(encrypted, padded);
+			}
+		}
+	}
+
+	Cipher_Config config(k1);
+	std::vector<std::byte> small(plain.size());
+	EXPECT_EQ(encrypt(plain, small, config), -1);
+	EXPECT_EQ(encrypt(std::span<std::byte>(small), config), -1);
+	EXPECT_EQ(encrypt(std::span<const std::byte>(), std::span<std::byte>(), config), 0);
+	EXPECT_THROW(Cipher_Config(k1, k2, k3, 7), std::runtime_error);
+}
+
+/*
+Coroutine for AsyncTest: starts at once, finished is ready when coroutine returns
+*/
+struct Test_Job
+{
+	struct promise_type
+	{
+		std::promise<void> done;
+		Test_Job get_return_object() { return Test_Job{ done.get_future() }; }
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() { done.set_value(); }
+		void unhandled_exception() { done.set_exception(std::current_exception()); }
+	};
+	std::future<void> finished;
+};
+
+/*
+Executor of caller: one thread resuming coroutines posted into the queue
+*/
+class Test_Reactor
+{
+public:
+	void post(std::coroutine_handle<> handle)
+	{
+		std::lock_guard<std::mutex> lck{ mtx };
+		queue.push_back(handle);
+		cv.notify_one();
+	}
+	// resumes posted coroutines until all jobs are finished
+	void run(std::vector<Test_Job>& jobs)
+	{
+		thread_id = std::this_thread::get_id();
+		for (Test_Job& job : jobs)
+		{
+			while (job.finished.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				std::unique_lock<std::mutex> lck{ mtx };
+				cv.wait_for(lck, std::chrono::milliseconds(10), [this]() { return !queue.empty(); });
+				while (!queue.empty())
+				{
+					std::coroutine_handle<> handle = queue.front();
+					queue.pop_front();
+					lck.unlock();
+					handle.resume();
+					lck.lock();
+				}
+			}
+		}
+	}
+	std::thread::id thread_id;
+private:
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::deque<std::coroutine_handle<>> queue;
+};
+
+static Test_Job encrypt_and_decrypt(Test_Reactor& reactor, std::vector<std::byte>& data, const Cipher_Config& config, std::vector<std::byte> expected)
+{
+	Resume_Fn resume_on = [&reactor](std::coroutine_handle<> handle) { reactor.post(handle); };
+	std::vector<std::byte> encrypted(padded_size(data.size()));
+	long long bytes = co_await encrypt_buffer_async(data, encrypted, config, resume_on);
+	EXPECT_EQ(bytes, (long long)encrypted.size());
+	EXPECT_EQ(std::this_thread::get_id(), reactor.thread_id);
+	EXPECT_EQ(encrypted, expected);
+	bytes = co_await decrypt_buffer_async(encrypted, encrypted, config, resume_on);
+	EXPECT_EQ(bytes, (long long)encrypted.size());
+	EXPECT_EQ(std::this_thread::get_id(), reactor.thread_id);
+	encrypted.resize(data.size());
+	data = encrypted;
+}
+
+static Test_Job encrypt_file(Test_Reactor& reactor, File_Crypter fc, int& result)
+{
+	result = co_await encrypt_file_async(fc, [&reactor](std::coroutine_handle<> handle) { reactor.post(handle); });
+	EXPECT_EQ(std::this_thread::get_id(), reactor.thread_id);
+}
+
+TEST(AsyncTest, DESTest)
+{
+	const std::string dir = memory_dir();
+	const std::string plain = "Files/1.png";
+	const std::string expected_file = dir + "desu_async_sync.enc";
+	Cipher_Config config(generate_random64(), generate_random64(), generate_random64(), File_Crypter::EDE3);
+	config.multithread = true;
+	Test_Reactor reactor;
+	std::vector<Test_Job> jobs;
+
+	// many jobs in flight on one reactor thread
+	const int BUFFERS = 8;
+	std::vector<std::vector<std::byte>> buffers(BUFFERS);
+	std::vector<std::vector<std::byte>> originals(BUFFERS);
+	for (int i = 0; i < BUFFERS; ++i)
+	{
+		buffers[i].resize(1000 * (i + 1) + i);
+		for (std::byte& b : buffers[i])
+		{
+			b = std::byte(generate_random64());
+		}
+		originals[i] = buffers[i];
+		std::vector<std::byte> expected(padded_size(buffers[i].size()));
+		ASSERT_GE(encrypt(buffers[i], expected, config), 0);
+		jobs.push_back(encrypt_and_decrypt(reactor, buffers[i], config, expected));
+	}
+
+	File_Crypter fc = config.crypter(File_Crypter::Encrypt);
+	fc.ifname = plain;
+	fc.ofname = expected_file;
+	ASSERT_EQ(fc.run(), 0);
+	const int FILES = 3;
+	std::vector<int> results(FILES + 1, 1);
+	for (int i = 0; i <= FILES; ++i)
+	{
+		fc.ofname = dir + "desu_async_" + std::to_string(i) + ".enc";
+		// the last one fails
+		fc.ifname = i < FILES ? plain : dir + "desu_no_such_file";
+		jobs.push_back(encrypt_file(reactor, fc, results[i]));
+	}
+
+	reactor.run(jobs);
+	for (Test_Job& job : jobs)
+	{
+		EXPECT_NO_THROW(job.finished.get());
+	}
+	for (int i = 0; i < BUFFERS; ++i)
+	{
+		EXPECT_EQ(buffers[i], originals[i]);
+	}
+	for (int i = 0; i <= FILES; ++i)
+	{
+		std::string fname = dir + "desu_async_" + std::to_string(i) + ".enc";
+		EXPECT_EQ(results[i], i < FILES ? 0 : -1);
+		if (i < FILES)
+		{
+			EXPECT_TRUE(are_files_equal(expected_file, fname));
+		}
+		std::remove(fname.c_str());
+	}
+	std::remove(expected_file.c_str());
+}
+
+TEST(ExecutorTest, DESTest)
+{
+	const std::string dir = memory_dir();
+	const std::string plain = "Files/1.png";
+	const std::string expected = dir + "desu_executor_st.enc";
+	const std::string output = dir + "desu_executor.enc";
+	File_Crypter fc;
+	fc.set_key(generate_random64());
+	fc.mode = fc.Encrypt;
+	fc.engine = File_Crypter::Table;
+	fc.buffer_size = 16 * 1024;
+	fc.ifname = plain;
+	fc.ofname = expected;
+	ASSERT_EQ(fc.run(), 0);
+
+	// caller's scheduler: bulk split between two threads of its own
+	std::atomic<int> bulks{ 0 };
+	Callback_Executor callback([&bulks](int count, const std::function<void(int)>& f)
+	{
+		++bulks;
+		std::thread helper([count, &f]()
+		{
+			for (int i = 1; i < count; i += 2)
+			{
+				f(i);
+			}
+		});
+		for (int i = 0; i < count; i += 2)
+		{
+			f(i);
+		}
+		helper.join();
+	}, 2);
+	ThreadPoolMy pool(2);
+	Pool_Executor pooled(pool);
+	Inline_Executor serial;
+	for (Executor* executor : std::initializer_list<Executor*>{ &callback, &pooled, &serial })
+	{
+		fc.multithread = true;
+		fc.adaptive = false;
+		fc.executor = executor;
+		fc.ofname = output;
+		ASSERT_EQ(fc.run(), 0);
+		EXPECT_TRUE(are_files_equal(expected, output));
+
+		Batch_Crypter batch(fc);
+		Batch_Item item;
+		item.ifname = plain;
+		item.ofname = output;
+		batch.items.push_back(item);
+		EXPECT_EQ(batch.run(), 0);
+		EXPECT_TRUE(are_files_equal(expected, output));
+	}
+	EXPECT_GT(bulks.load(), 1);
+	EXPECT_EQ(pooled.concurrency(), 3);
+
+	// bulk_execute runs every task once
+	std::vector<std::atomic<int>> done(100);
+	for (Executor* executor : std::initializer_list<Executor*>{ &callback, &pooled, &serial })
+	{
+		executor->bulk_execute(done.size(), [&done](int i) { ++done[i]; });
+	}
+	for (std::atomic<int>& count : done)
+	{
+		EXPECT_EQ(count.load(), 3);
+	}
+
+	// buffer API goes through executor too
+	Cipher_Config config(generate_random64());
+	config.multithread = true;
+	config.adaptive = false;
+	std::vector<std::byte> data(64 * 1024, std::byte(1));
+	std::vector<std::byte> reference(data.size());
+	ASSERT_EQ(encrypt(data, reference, config), (long long)data.size());
+	int before = bulks;
+	config.executor = &callback;
+	std::vector<std::byte> result(data.size());
+	ASSERT_EQ(encrypt(data, result, config), (long long)data.size());
+	EXPECT_EQ(result, reference);
+	EXPECT_EQ(bulks.load(), before + 1);
+	std::remove(expected.c_str());
+	std::remove(output.c_str());
+}
+
+static std::string read_whole_file(const std::string& fname)
+{
+	std::ifstream ifs(fname, std::ios_base::binary);
+	return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+TEST(ChecksumTest, DESTest)
+{
+	const std::string check = "123456789";
+	EXPECT_EQ(crc32c(0, check.data(), check.size()), 0xE3069283u);
+	EXPECT_EQ(crc32c(crc32c(0, check.data(), 4), check.data() + 4, 5), 0xE3069283u);
+	EXPECT_EQ(crc32c_combine(crc32c(0, check.data(), 4), crc32c(0, check.data() + 4, 5), 5), 0xE3069283u);
+	EXPECT_EQ(xxh64("", 0, 0), 0xEF46DB3751D8E999ull);
+	EXPECT_EQ(xxh64("abc", 3, 0), 0x44BC2CF5AD770999ull);
+	const std::string long_text = "Nobody inspects the spammish repetition";
+	EXPECT_EQ(xxh64(long_text.data(), long_text.size(), 0), 0xFBCEA83C8A378BF1ull);
+
+	// fused checksums are the same for any chunk size and threads, crc32c is CRC32C of files
+	const std::string dir = memory_dir();
+	// several leaves and chunks, last leaf is not whole and not padded
+	const std::string plain = dir + "desu_checksum.bin";
+	const std::string output = dir + "desu_checksum.enc";
+	std::string plain_data(5 * CHECKSUM_LEAF + 12345, 0);
+	for (char& c : plain_data)
+	{
+		c = (char)generate_random64();
+	}
+	{
+		std::ofstream ofs(plain, std::ios_base::binary);
+		ofs.write(plain_data.data(), plain_data.size());
+	}
+	ThreadPoolMy pool(3);
+	for (int kind : { CHECKSUM_CRC32C, CHECKSUM_XXH64 })
+	{
+		uint64_t input_value = 0;
+		uint64_t output_value = 0;
+		for (int run = 0; run < 4; ++run)
+		{
+			SCOPED_TRACE(std::string(checksum_name(kind)) + " " + std::to_string(run));
+			File_Crypter fc;
+			fc.set_key(0x133457799BBCDFF1ull);
+			fc.mode = fc.Encrypt;
+			fc.engine = File_Crypter::Table;
+			fc.checksum = kind;
+			fc.ifname = plain;
+			fc.ofname = output;
+			fc.buffer_size = run % 2 ? 3 * CHECKSUM_LEAF + 100 : BUFSIZE;
+			fc.multithread = run >= 2;
+			fc.adaptive = false;
+			fc.thread_pool = &pool;
+			ASSERT_EQ(fc.run(), 0);
+			EXPECT_EQ(fc.input_checksum.bytes(), (long long)plain_data.size());
+			EXPECT_EQ(fc.output_checksum.bytes(), get_file_size(output));
+			if (kind == CHECKSUM_CRC32C)
+			{
+				std::string output_data = read_whole_file(output);
+				EXPECT_EQ(fc.input_checksum.value(), crc32c(0, plain_data.data(), plain_data.size()));
+				EXPECT_EQ(fc.output_checksum.value(), crc32c(0, output_data.data(), output_data.size()));
+			}
+			if (run > 0)
+			{
+				EXPECT_EQ(fc.input_checksum.value(), input_value);
+				EXPECT_EQ(fc.output_checksum.value(), output_value);
+			}
+			input_value = fc.input_checksum.value();
+			output_value = fc.output_checksum.value();
+
+			const std::string sidecar = output + ".sum";
+			ASSERT_TRUE(save_checksums(sidecar, fc.input_checksum, fc.output_checksum));
+			int loaded_kind = NO_CHECKSUM;
+			uint64_t loaded_input = 0, loaded_output = 0;
+			ASSERT_TRUE(load_checksums(sidecar, loaded_kind, loaded_input, loaded_output));
+			EXPECT_EQ(loaded_kind, kind);
+			EXPECT_EQ(loaded_input, input_value);
+			EXPECT_EQ(loaded_output, output_value);
+			std::remove(sidecar.c_str());
+		}
+	}
+	std::remove(plain.c_str());
+	std::remove(output.c_str());
+}
+
+TEST(IncrementalTest, DESTest)
+{
+	const std::string dir = memory_dir();
+	const std::string plain = dir + "desu_incremental.bin";
+	const std::string output = dir + "desu_incremental.enc";
+	const std::string expected = dir + "desu_incremental_expected.enc";
+	const int chunk = 64 * 1024;
+	std::string plain_data(10 * chunk + 1001, 0);
+	for (char& c : plain_data)
+	{
+		c = (char)generate_random64();
+	}
+	ThreadPoolMy pool(3);
+	File_Crypter fc;
+	fc.set_3keys(0x133457799BBCDFF1ull, 0x0E329232EA6D0D73ull, 0x3b3898371520f75eull);
+	fc.triple_des = true;
+	fc.set_triple_des_mode(File_Crypter::EDE3);
+	fc.mode = fc.Encrypt;
+	fc.engine = File_Crypter::Table;
+	fc.buffer_size = chunk;
+	fc.ifname = plain;
+	fc.ofname = output;
+
+	// output must be the same as of full run every time
+	auto run_and_check = [&](bool multithread, long long changed, bool full)
+	{
+		{
+			std::ofstream ofs(plain, std::ios_base::binary);
+			ofs.write(plain_data.data(), plain_data.size());
+		}
+		fc.multithread = multithread;
+		Incremental_Crypter incremental(fc);
+		incremental.thread_pool = &pool;
+		ASSERT_EQ(incremental.run(), 0);
+		EXPECT_EQ(incremental.full, full);
+		EXPECT_EQ(incremental.changed_chunks, changed);
+		EXPECT_EQ(incremental.chunks, ((long long)plain_data.size() + chunk - 1) / chunk);
+		EXPECT_EQ(incremental.stats.bytes, (long long)plain_data.size());
+		File_Crypter reference = fc;
+		reference.multithread = false;
+		reference.ofname = expected;
+		ASSERT_EQ(reference.run(), 0);
+		EXPECT_TRUE(read_whole_file(output) == read_whole_file(expected));
+	};
+
+	run_and_check(false, 11, true);
+	// two chunks changed
+	plain_data[2 * chunk + 5] ^= 1;
+	plain_data[7 * chunk] ^= 0x80;
+	run_and_check(true, 2, false);
+	run_and_check(false, 0, false);
+	// input got shorter, the last chunk is partial now
+	plain_data.resize(4 * chunk + 13);
+	run_and_check(true, 1, false);
+	// and longer
+	plain_data.append(3 * chunk, 'x');
+	run_and_check(false, 4, false);
+	Chunk_Manifest manifest;
+	ASSERT_TRUE(load_manifest(manifest_name(output), manifest));
+	EXPECT_EQ(manifest.input_bytes, (long long)plain_data.size());
+	EXPECT_EQ(manifest.hashes.size(), 8u);
+	// hashes are keyed, plain XXH64 of chunk can't be checked against them
+	EXPECT_NE(manifest.hashes[0], xxh64(plain_data.data(), chunk, 0));
+	// other keys make the whole output
+	fc.set_3keys(1, 2, 3);
+	run_and_check(true, 8, true);
+	// so does output changed in size
+	{
+		std::ofstream ofs(output, std::ios_base::binary | std::ios_base::app);
+		ofs << "tail";
+	}
+	run_and_check(false, 8, true);
+
+	std::remove(plain.c_str());
+	std::remove(output.c_str());
+	std::remove(expected.c_str());
+	std::remove(manifest_name(output).c_str());
+}
+
+TEST(CheckpointTest, DESTest)
+{
+	const std::string dir = memory_dir();
+	const std::string plain = dir + "desu_checkpoint.bin";
+	const std::string output = dir + "desu_checkpoint.enc";
+	const std::string expected = dir + "desu_checkpoint_expected.enc";
+	const std::string checkpoint = dir + "desu_checkpoint.ckpt";
+	const int chunk = 64 * 1024;
+	std::string plain_data(20 * chunk + 77, 0);
+	for (char& c : plain_data)
+	{
+		c = (char)generate_random64();
+	}
+	{
+		std::ofstream ofs(plain, std::ios_base::binary);
+		ofs.write(plain_data.data(), plain_data.size());
+	}
+	std::remove(checkpoint.c_str());
+	File_Crypter fc;
+	fc.set_key(0x133457799BBCDFF1ull);
+	fc.mode = fc.Encrypt;
+	fc.engine = File_Crypter::Table;
+	fc.buffer_size = chunk;
+	fc.ifname = plain;
+	fc.ofname = expected;
+	ASSERT_EQ(fc.run(), 0);
+	const std::string expected_data = read_whole_file(expected);
+	fc.ofname = output;
+	fc.checkpoint = checkpoint;
+	fc.checkpoint_interval = 3;
+
+	// interrupted in the middle: chunks after the stop_at-th one are not processed
+	auto interrupted_run = [&](int stop_at)
+	{
+		int started = 0;
+		Callback_Executor stopping([&started, stop_at](int count, const std::function<void(int)>& f)
+		{
+			if (started++ == stop_at)
+			{
+				throw std::runtime_error("preempted");
+			}
+			for (int i = 0; i < count; ++i)
+			{
+				f(i);
+			}
+		}, 2);
+		File_Crypter broken = fc;
+		broken.multithread = true;
+		broken.adaptive = false;
+		broken.executor = &stopping;
+		EXPECT_EQ(broken.run(), -1);
+	};
+
+	interrupted_run(11);
+	Checkpoint saved;
+	ASSERT_TRUE(load_checkpoint(checkpoint, saved));
+	EXPECT_EQ(saved.done_chunks, 9);
+	EXPECT_EQ(saved.input_offset, 9LL * chunk);
+	EXPECT_EQ(saved.output_offset, 9LL * chunk);
+	EXPECT_EQ(saved.tail.size(), (size_t)CHECKPOINT_TAIL);
+	// resumed by run in other mode(multithread, out of order portions)
+	ThreadPoolMy pool(3);
+	fc.multithread = true;
+	fc.adaptive = false;
+	fc.thread_pool = &pool;
+	ASSERT_EQ(fc.run(), 0);
+	EXPECT_EQ(fc.resumed_bytes, 9LL * chunk);
+	EXPECT_EQ(fc.stats.bytes, (long long)plain_data.size() - 9LL * chunk);
+	EXPECT_TRUE(read_whole_file(output) == expected_data);
+	EXPECT_FALSE(std::filesystem::exists(checkpoint));
+
+	// lost tail of output means the run from the beginning
+	interrupted_run(7);
+	ASSERT_TRUE(load_checkpoint(checkpoint, saved));
+	{
+		std::fstream fs(output, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		fs.seekp(saved.output_offset - 1);
+		fs.put('\0');
+	}
+	fc.multithread = false;
+	ASSERT_EQ(fc.run(), 0);
+	EXPECT_EQ(fc.resumed_bytes, 0);
+	EXPECT_TRUE(read_whole_file(output) == expected_data);
+	// so do other keys
+	interrupted_run(7);
+	fc.set_key(0x0E329232EA6D0D73ull);
+	ASSERT_EQ(fc.run(), 0);
+	EXPECT_EQ(fc.resumed_bytes, 0);
+	EXPECT_FALSE(std::filesystem::exists(checkpoint));
+
+	std::remove(plain.c_str());
+	std::remove(output.c_str());
+	std::remove(expected.c_str());
+}
+
+TEST(ShardTest, DESTest)
+{
+	const std::string dir = memory_dir();
+	const std::string plain = dir + "desu_shard.bin";
+	const std::string expected = dir + "desu_shard_expected.enc";
+	const std::string shared = dir + "desu_shard_shared.enc";
+	const std::string merged = dir + "desu_shard_merged.enc";
+	// the last block is not whole
+	std::string plain_data(3 * BUFSIZE + 4097, 0);
+	for (char& c : plain_data)
+	{
+		c = (char)generate_random64();
+	}
+	{
+		std::ofstream ofs(plain, std::ios_base::binary);
+		ofs.write(plain_data.data(), plain_data.size());
+	}
+	ThreadPoolMy pool(3);
+	File_Crypter fc;
+	fc.set_key(0x133457799BBCDFF1ull);
+	fc.mode = fc.Encrypt;
+	fc.engine = File_Crypter::Table;
+	fc.thread_pool = &pool;
+	fc.ifname = plain;
+	fc.ofname = expected;
+	ASSERT_EQ(fc.run(), 0);
+	const std::string expected_data = read_whole_file(expected);
+
+	const int count = 5;
+	long long start, end;
+	shard_range(plain_data.size(), count - 1, count, start, end);
+	EXPECT_EQ(end, (long long)plain_data.size());
+	// stale longer output is cut by the last shard
+	{
+		std::ofstream ofs(shared, std::ios_base::binary);
+		ofs << std::string(plain_data.size() + 100, 'x');
+	}
+	std::vector<std::string> shard_files;
+	// in reverse order, as processes may finish
+	for (int index = count - 1; index >= 0; --index)
+	{
+		SCOPED_TRACE(index);
+		shard_range(plain_data.size(), index, count, start, end);
+		EXPECT_EQ(start % BLOCKSIZE, 0);
+		File_Crypter part = fc;
+		part.multithread = index % 2;
+		part.range_start = start;
+		part.range_end = end;
+		part.ofname = dir + "desu_shard_" + std::to_string(index) + ".shard";
+		ASSERT_EQ(part.run(), 0);
+		EXPECT_EQ(part.stats.bytes, end - start);
+		shard_files.push_back(part.ofname);
+		part.ofname = shared;
+		part.shared_output = true;
+		ASSERT_EQ(part.run(), 0);
+	}
+	EXPECT_TRUE(read_whole_file(shared) == expected_data);
+	std::string error;
+	ASSERT_EQ(merge_shards(shard_files, merged, error), 0) << error;
+	EXPECT_TRUE(read_whole_file(merged) == expected_data);
+	// merged decryption by shards is the input padded to blocks
+	File_Crypter back = fc;
+	back.mode = back.Decrypt;
+	back.ifname = merged;
+	back.ofname = dir + "desu_shard_0.shard";
+	back.range_start = 0;
+	back.range_end = 2 * BUFSIZE;
+	ASSERT_EQ(back.run(), 0);
+	back.ofname = dir + "desu_shard_1.shard";
+	back.range_start = 2 * BUFSIZE;
+	back.range_end = -1;
+	ASSERT_EQ(back.run(), 0);
+	ASSERT_EQ(merge_shards({ dir + "desu_shard_1.shard", dir + "desu_shard_0.shard" }, merged, error), 0) << error;
+	std::string decrypted = read_whole_file(merged);
+	ASSERT_EQ(decrypted.size(), (plain_data.size() + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE);
+	EXPECT_TRUE(decrypted.substr(0, plain_data.size()) == plain_data);
+
+	// gap, not aligned range
+	EXPECT_EQ(merge_shards({ shard_files[0], shard_files[2] }, merged, error), -1);
+	EXPECT_EQ(merge_shards({ plain }, merged, error), -1);
+	File_Crypter unaligned = fc;
+	unaligned.range_start = 4;
+	EXPECT_EQ(unaligned.run(), -1);
+
+	for (const std::string& fname : shard_files)
+	{
+		std::remove(fname.c_str());
+	}
+	for (const std::string& fname : { plain, expected, shared, merged })
+	{
+		std::remove(fname.c_str());
+	}
+}